@@ -10,17 +10,17 @@ int destroyBoundedBuffer(BoundedBuffer* buf);
 
 int dequeue(BoundedBuffer* buf, void* dest, size_t destSize);
 /*!
-Allocates a new node with the given value and pushes it to the tail
-of the bounded buffer.
+Copies the given value into a free slot at the tail of the bounded buffer.
 
 \param buf is the buffer the data is going to be pushed to
 \param data is a pointer to the data to be pushed
 
 If the buffer is full, waits until there is at least one free spot.
 
-@return 0 on success, -1 if it is unable to allocate memory for the new node.
+@return 0 on success, -1 if invalid parameters were passed.
 */
 
 int enqueue(BoundedBuffer* buf, void* data, size_t upTo);
+int tryEnqueue(BoundedBuffer* buf, void* data, size_t upTo);
 
 #endif
@@ -1,15 +1,59 @@
 #ifndef CACHE_FNS_H
 #define CACHE_FNS_H
 
+#include <stdbool.h>
 
 #define FIFO_ALGO 0
 #define LRU_ALGO 1
 #define LFU_ALGO 2
+#define ARC_ALGO 3
+#define GDSF_ALGO 4
+#define NUM_REPLACEMENT_ALGOS 5
 
-/**
- * Defines comparator functions used by the cache heap to determine the files
- * to evict.
- */
+// what GDSF should maximize: the fraction of requests for files that are in the storage, or of bytes
+#define GDSF_OBJECT_HIT_RATIO 0
+#define GDSF_BYTE_HIT_RATIO 1
+
+struct fileNode;
+
+typedef bool (*IsEvictableFn_t)(struct fileNode* fptr, void* arg); /**< Tells whether a file can be chosen as a victim right now */
+
+typedef struct evictionPolicy {
+    /**
+     * @brief Operations of a replacement algorithm.
+     *
+     * Every shard of the storage has its own instance of the algorithm's state, holding the shard's files \n
+     * in the order they should be evicted in. All operations but the ones that allocate or free state are \n
+     * called while holding the shard's `evictionOrderMutex`.
+     */
+    const char* name;
+
+    /**
+     * Returns the state shared by all the shards, configured with `option`, or NULL on error (sets `errno`). \n
+     * NULL if the algorithm doesn't need any.
+     */
+    void* (*allocShared)(long option);
+    void (*destroyShared)(void* shared);
+
+    void* (*allocState)(void* shared); /**< Returns the state for a new, empty shard, or NULL on error (sets `errno`) */
+    void (*destroyState)(void* state); /**< Frees the state of a shard that holds no files anymore */
+
+    void (*onInsert)(void* state, struct fileNode* fptr); /**< A file has been added to the shard */
+    void (*onAccess)(void* state, struct fileNode* fptr); /**< A file of the shard has been used; NULL if the algorithm doesn't care */
+    void (*onRemove)(void* state, struct fileNode* fptr, bool evicted); /**< A file is being removed from the shard, or evicted from it */
+    void (*onResize)(void* state, struct fileNode* fptr); /**< The content of a file of the shard changed size; NULL if the algorithm doesn't care */
+
+    /**
+     * Returns the file of the shard that should be evicted first among the ones for which `isEvictable(fptr, arg)` \n
+     * is true, or NULL if there are none.
+     */
+    struct fileNode* (*pickVictim)(void* state, IsEvictableFn_t isEvictable, void* arg);
+    /**
+     * Compares the victims proposed by two shards: returns a positive number if `f1` should be evicted \n
+     * before `f2`, a negative one if `f2` should be evicted first, 0 if they're equally good victims.
+     */
+    int (*cmp)(const void* f1, const void* f2);
+} EvictionPolicy_t;
 
 int lru_cmp(const void* f1, const void* f2);
 
@@ -17,6 +61,10 @@ int lfu_cmp(const void* f1, const void* f2);
 
 int fifo_cmp(const void* f1, const void* f2);
 
-extern int (*cmp_fns[3])(const void* f1, const void* f2);
+int gdsf_cmp(const void* f1, const void* f2);
+
+int arc_cmp(const void* f1, const void* f2);
+
+extern const EvictionPolicy_t* evictionPolicies[NUM_REPLACEMENT_ALGOS];
 
-#endif
\ No newline at end of file
+#endif
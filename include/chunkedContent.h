@@ -0,0 +1,39 @@
+#ifndef CHUNKED_CONTENT_H
+#define CHUNKED_CONTENT_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "sharedBuffer.h"
+
+#define CHUNK_SIZE ((size_t)64 * 1024) /**< Max number of uncompressed bytes in a chunk */
+#define SMALL_CHUNK_SIZE (CHUNK_SIZE / 2) /**< Any two adjacent chunks smaller than this can be merged */
+
+typedef struct contentChunk {
+    SharedBuffer_t* data; /**< Compressed bytes, shared by all the versions of the content that include the chunk */
+    size_t compressedSize;
+    size_t uncompressedSize;
+    size_t offset; /**< Offset of the chunk's first byte in the uncompressed content */
+    unsigned char codec; /**< One of the `CODEC_*` constants */
+} ContentChunk_t;
+
+typedef struct fileContent {
+    size_t refs; /**< Only accessed atomically; the version is freed when the last reference is released */
+    size_t uncompressedSize;
+    size_t compressedSize; /**< Sum of the compressed sizes of the chunks */
+    size_t numSmallChunks; /**< Number of chunks smaller than `SMALL_CHUNK_SIZE` */
+    size_t numChunks;
+    ContentChunk_t chunks[];
+} FileContent_t;
+
+FileContent_t* appendToContent(const FileContent_t* content, const char* data, size_t size, unsigned char codec);
+FileContent_t* compactContent(const FileContent_t* content, unsigned char codec);
+void acquireContent(FileContent_t* content);
+void releaseContent(FileContent_t* content);
+size_t contentOverhead(const FileContent_t* content);
+
+char* decompressContent(const FileContent_t* content, size_t extraAllocation);
+void decompressContentTo(const FileContent_t* content, char* dest);
+SharedBuffer_t* shareRawRange(const FileContent_t* content, size_t offset, size_t len, const char** data);
+int decompressContentRange(const FileContent_t* content, size_t offset, size_t len, char* dest);
+
+#endif
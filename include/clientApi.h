@@ -15,6 +15,7 @@ int openConnection(const char* sockname, int msec, const struct timespec abstime
 int closeConnection(const char* sockname);
 int openFile(const char* pathname, int flags);
 int readFile(const char* pathname, void** buf, size_t* size);
+int readFileRange(const char* pathname, size_t offset, size_t len, void** buf, size_t* size);
 int readNFiles(int N, const char* dirname);
 int writeFile(const char* pathname, const char* dirname);
 int appendToFile(const char* pathname, void* buf, size_t size, const char* dirname);
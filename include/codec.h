@@ -0,0 +1,32 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdlib.h>
+
+#define CODEC_NONE 0
+#define CODEC_RLE 1
+#define CODEC_LZ 2
+#define CODEC_RLE2 3
+#define NUM_CODECS 4
+
+typedef struct compressionCodec {
+    /**
+     * @brief Operations of a compression codec.
+     *
+     * Codecs work on caller-provided buffers and never fail: `compress` can always write its output to a buffer \n
+     * of `maxCompressedSize(size)` bytes.
+     */
+    const char* name;
+
+    size_t (*maxCompressedSize)(size_t size); /**< Worst case size of the output of `compress` for `size` bytes of input */
+    size_t (*compress)(const char* src, size_t size, char* dest); /**< Returns the size of the compressed data */
+    /**
+     * Decompresses data into `dest`, stopping after `uncompressedSize` bytes (which can be fewer than the original \n
+     * size of the data, to only decompress its beginning); returns the number of bytes written.
+     */
+    size_t (*decompress)(const char* src, size_t compressedSize, char* dest, size_t uncompressedSize);
+} CompressionCodec_t;
+
+extern const CompressionCodec_t* codecs[NUM_CODECS];
+
+#endif
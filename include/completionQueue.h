@@ -0,0 +1,26 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define COMPLETION_REARM 1 /*< The worker is done with the client's request: its fd can be re-armed */
+#define COMPLETION_CLIENT_LEFT 2 /*< The client closed the connection and its fd has been closed */
+#define COMPLETION_LOCK_GRANTED 3 /*< A client that was waiting to lock a file got the lock: its fd can be re-armed */
+
+struct completion {
+    int fd;
+    int type;
+};
+
+typedef struct _completionQueue CompletionQueue;
+
+CompletionQueue* allocCompletionQueue(size_t capacity);
+int destroyCompletionQueue(CompletionQueue* queue);
+int getCompletionQueueFd(const CompletionQueue* queue);
+
+int pushCompletion(CompletionQueue* queue, int fd, int type);
+int beginDrain(CompletionQueue* queue);
+bool popCompletion(CompletionQueue* queue, struct completion* dest);
+
+#endif
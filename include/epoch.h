@@ -0,0 +1,16 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdlib.h>
+
+typedef struct _epochDomain EpochDomain;
+
+EpochDomain* allocEpochDomain(void);
+int destroyEpochDomain(EpochDomain* domain);
+
+void epochEnter(EpochDomain* domain);
+void epochExit(EpochDomain* domain);
+void epochRetire(EpochDomain* domain, void* ptr, void (*freeFn)(void*));
+void epochReclaim(EpochDomain* domain);
+
+#endif
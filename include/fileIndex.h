@@ -0,0 +1,21 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "epoch.h"
+
+typedef struct _fileIndex FileIndex;
+
+uint64_t hashPathname(const char* pathname);
+
+FileIndex* allocFileIndex(size_t capacity, EpochDomain* epochs);
+int destroyFileIndex(FileIndex* index);
+
+void* fileIndexFind(FileIndex* index, const char* key, uint64_t hash);
+int fileIndexInsert(FileIndex* index, const char* key, uint64_t hash, void* value);
+int fileIndexRemove(FileIndex* index, const char* key, uint64_t hash);
+size_t fileIndexSize(const FileIndex* index);
+size_t fileIndexFootprint(const FileIndex* index);
+
+#endif
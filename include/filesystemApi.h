@@ -6,70 +6,171 @@
 #include <pthread.h>
 #include <string.h>
 #include "boundedbuffer.h"
-#include "icl_hash.h"
+#include "fileIndex.h"
+#include "cacheFns.h"
+#include "frequencySketch.h"
+#include "chunkedContent.h"
+#include "sharedBuffer.h"
+#include "epoch.h"
+#include "slab.h"
+#include "parkingLot.h"
+
+#define STORE_SHARDS 16 /*< Number of partitions of the storage, each with its own mutex (must be a power of two) */
+#define HOT_CACHE_MIN_READS 2 /*< Number of whole-file reads since the last write after which a file's decompressed image is cached */
+#define SHORT_PATHNAME_LEN 64 /*< Pathnames up to this long (including the terminator) are stored in the file node itself */
 
 struct fdNode {
     int fd;
     struct fdNode* nextPtr;
 };
-typedef struct fileNode {
+
+struct compactionRequest {
     char* pathname;
-    char* content;
-    size_t contentSize;
-    size_t uncompressedSize;
+    uint64_t pathHash;
+    struct compactionRequest* nextPtr;
+};
+typedef struct fileNode {
+    char* pathname; /*< Points to `shortPathname` if the pathname fits in it, otherwise to a copy of exactly its size */
+    uint64_t pathHash; /*< `hashPathname(pathname)`, computed once when the file is created */
+    FileContent_t* content; /*< Current version of the content, compressed chunk by chunk (NULL if empty); only written atomically, \
+                               with the file's mutex held, and replaced rather than modified: readers take references to it */
+    size_t smallChunksAfterCompaction; /*< `numSmallChunks` of the content after the last compaction, which can leave some small chunks behind */
+    bool compactionQueued; /*< The file is waiting for its small chunks to be merged */
+    size_t contentSize; /*< Sum of the compressed sizes of the chunks of the current content */
+    size_t uncompressedSize; /*< Size of the current content */
+    unsigned char codec; /*< Codec new content of the file is compressed with (`CODEC_*`); each chunk records the one it was compressed with */
 
     int lockedBy; /*< 0 if unlocked */
     struct fdNode* pendingLocks_hPtr; /*< List of fd's that are waiting to acquire lock for this file */
     struct fdNode* openDescriptors; /*< List of fd's that have called `openFile` on this file */
 
-    bool isBeingWritten;
+    bool removed; /*< The file has been removed from the storage, but threads that looked it up before might still hold a pointer to it */
+    bool isBeingWritten; /*< A writer is building the next version of the content; readers can still read the current one */
+    WordLock_t mutex;
+    WordLock_t ordering;
+    WordCond_t rwCond; /*< Used to guarantee at most 1 writer at a time, and that nobody is reading or writing the file while it is locked or destroyed */
     size_t activeReaders;
 
-    int canDoFirstWrite; /*< Fd of the client who created the file with O_LOCK|O_CREATE and can do the first write on this file */
-
-    pthread_mutex_t mutex;
-    pthread_mutex_t ordering;
+    SharedBuffer_t* image; /*< Decompressed content of the file, if it's in its shard's hot cache; guarded by the shard's `hotMutex` */
+    const FileContent_t* imageOf; /*< Version of the content `image` holds */
+    size_t readsSinceWrite; /*< Number of whole-file reads since the content last changed */
+    struct fileNode* hotPrev; /*< Neighbours of the file in its shard's hot cache, most recently read first */
+    struct fileNode* hotNext;
 
-    pthread_cond_t rwCond; /*< Used to guarantee at most 1 writer at a time */
+    int canDoFirstWrite; /*< Fd of the client who created the file with O_LOCK|O_CREATE and can do the first write on this file */
 
-    size_t refCount; /*< # of times the file was used since last iteration of LFU algorithm */
-    time_t lastRef; /*< time elapsed since the last time the file was used - used for LRU algorithm */
-    time_t insertionTime; /*< time of insertion of file in cache - used for FIFO algorithm*/
+    size_t refCount; /*< # of times the file was used (periodically halved by LFU) - used for LFU and GDSF algorithms */
+    uint64_t lastRef; /*< tick of the storage's clock at which the file was last used - used for LRU algorithm */
+    uint64_t insertionTime; /*< tick of the storage's clock at which the file was inserted in cache - used for FIFO algorithm*/
+    size_t numOpens; /*< # of times the file was opened, counting its creation - used for ARC algorithm */
+    bool arcFrequent; /*< Only accessed atomically; whether the file is in the list of files used more than once - used for ARC algorithm */
+    size_t insertionSeq; /*< position of the file in the order of insertion across all shards - used to break ties between victims */
+    double priority; /*< L + frequency * cost / size, as of the last time the file was inserted, used or resized - used for GDSF algorithm */
+    size_t heapIdx; /*< position of the file in its shard's heap - used for GDSF algorithm */
 
     struct fileNode* prevPtr;
     struct fileNode* nextPtr;
-} FileNode_t;
 
+    struct fileNode* evictPrev; /*< Neighbours of the file in its shard's eviction order */
+    struct fileNode* evictNext;
+    void* evictionData; /*< Owned by the replacement algorithm */
+
+    char shortPathname[SHORT_PATHNAME_LEN];
+} FileNode_t;
 
-typedef struct cacheStorage {
-    size_t maxFileNum;
-    size_t maxStorageSize;
-    size_t currFileNum;
-    size_t currStorageSize;
 
-    short replacementAlgo; /*< 0 FIFO; 1 LRU; 2 LFU */
+typedef struct storeShard {
+    pthread_mutex_t mutex; /*< Guards the shard's dictionary and file list */
 
-    FileNode_t* hPtr;
+    FileNode_t* hPtr; /*< Files of the shard, in insertion order */
     FileNode_t* tPtr;
-    icl_hash_t* dictStore;
+    FileIndex* dictStore;
+
+    pthread_mutex_t evictionOrderMutex; /*< Guards the eviction order; never held while acquiring any other mutex */
+    void* evictionState; /*< State of the replacement algorithm for the shard's files */
+
+    pthread_mutex_t hotMutex; /*< Guards the hot cache and the files' `image`; never held while acquiring any other mutex */
+    FileNode_t* hotHead; /*< Files whose decompressed image is cached, most recently read first */
+    FileNode_t* hotTail;
+    size_t hotBytes; /*< Total size of the cached images */
+} StoreShard_t;
 
-    pthread_mutex_t mutex;
+
+typedef struct cacheStorage {
+    size_t maxFileNum;
+    size_t maxStorageSize;
+    size_t currFileNum; /*< Only accessed atomically; includes slots reserved for files that are being created */
+    size_t currStorageSize; /*< Only accessed atomically */
+
+    short replacementAlgo; /*< 0 FIFO; 1 LRU; 2 LFU; 3 ARC; 4 GDSF */
+    const EvictionPolicy_t* policy; /*< `evictionPolicies[replacementAlgo]` */
+    void* evictionShared; /*< State of the replacement algorithm shared by all the shards, if any */
+    FrequencySketch* admissionSketch; /*< Counts how many times each pathname is opened; NULL if the admission filter is disabled */
+    unsigned char defaultCodec; /*< Codec the content of new files is compressed with */
+    size_t hotCacheShardBudget; /*< Maximum size of the decompressed images cached by each shard; 0 disables the hot cache */
+    SlabAllocator* fileSlab; /*< Allocator of the file nodes */
+    EpochDomain* epochs; /*< Readers look files up inside an epoch, without holding shard mutexes: removed files are freed when they're done */
+
+    StoreShard_t shards[STORE_SHARDS]; /*< Files are partitioned among the shards by hash of their pathname */
+
+    pthread_mutex_t evictionMutex; /*< Serializes evictions; must be acquired before any shard mutex */
+    pthread_mutex_t idleMutex;
+    pthread_cond_t idleCond; /*< Broadcast when an operation on a file ends, or a file is added or removed, while threads are waiting for a victim */
+    size_t idleGeneration; /*< Bumped every time `idleCond` is broadcast */
+    size_t idleWaiters; /*< Only accessed atomically; number of threads that ran out of victims and wait for files to become evictable */
+    bool backgroundEviction; /*< Whether a thread evicts files in the background, keeping the storage between its watermarks */
+    size_t highWatermarkFileNum; /*< The background evictor is woken up when there are more files than this... */
+    size_t highWatermarkStorageSize; /*< ...or the storage is larger than this */
+    size_t lowWatermarkFileNum; /*< The background evictor evicts files until there are at most this many... */
+    size_t lowWatermarkStorageSize; /*< ...and the storage is at most this large */
+    pthread_mutex_t evictorMutex;
+    pthread_cond_t evictorCond; /*< Signaled when the storage goes past a high watermark, or when the background evictor has to exit */
+    bool evictionRequested; /*< Only accessed atomically; whether the background evictor has been woken up */
+    bool evictorExit;
+
+    pthread_mutex_t compactorMutex;
+    pthread_cond_t compactorCond; /*< Signaled when a file is queued for compaction, or when the background compactor has to exit */
+    struct compactionRequest* compactionHead; /*< Files whose small chunks should be merged, in the order they were queued */
+    struct compactionRequest* compactionTail;
+    bool compactorExit;
+
+    size_t insertionCounter; /*< Only accessed atomically; source of `insertionSeq` for new files */
+    uint64_t clock; /*< Only accessed atomically; logical clock that ticks whenever a file is inserted or used */
 
     BoundedBuffer* logBuffer;
 
     size_t maxReachedFileNum;
     size_t maxReachedStorageSize;
     size_t numVictims;
+    size_t numRejected; /*< Number of new files that were rejected by the admission filter */
+    size_t numHotReads; /*< Only accessed atomically; number of reads served from the hot cache */
 } CacheStorage_t;
 
+typedef struct storageOverhead {
+    size_t numFiles; /*< Files in the storage */
+    size_t nodeBytes; /*< Nodes of the files in the storage */
+    size_t pathnameBytes; /*< Pathnames that don't fit in their node */
+    size_t contentBytes; /*< Metadata of the current versions of the contents */
+    size_t preallocatedBytes; /*< Index tables and file nodes allocated in advance, or not reclaimed yet: doesn't depend on the number of files */
+} StorageOverhead_t;
+
 
-CacheStorage_t* allocStorage(const size_t maxFileNum, const size_t maxStorageSize, const short replacementAlgo);
+CacheStorage_t* allocStorage(const size_t maxFileNum, const size_t maxStorageSize, const short replacementAlgo, const long replacementOption, const bool admissionFilter);
 void printStore(const CacheStorage_t* store);
+int setEvictionWatermarks(CacheStorage_t* store, const size_t highWatermark, const size_t lowWatermark);
+int setDefaultCodec(CacheStorage_t* store, const unsigned char codec);
+int setHotCacheSize(CacheStorage_t* store, const size_t maxHotCacheSize);
+bool evictInBackground(CacheStorage_t* store, struct fdNode** notifyList);
+void stopBackgroundEviction(CacheStorage_t* store);
+bool compactInBackground(CacheStorage_t* store, struct fdNode** notifyList);
+void stopBackgroundCompaction(CacheStorage_t* store);
 int destroyStorage(CacheStorage_t* store);
+void storageOverhead(CacheStorage_t* store, StorageOverhead_t* overhead);
 int logEvent(BoundedBuffer* buffer, const char* op, const char* pathname, int outcome, int requestor, size_t processedSize);
 
 int openFileHandler(CacheStorage_t* store, const char* pathname, int flags, struct fdNode** notifyList, const int requestor);
-int readFileHandler(CacheStorage_t* store, const char* pathname, void** buf, size_t* size, const int requestor);
+int readFileHandler(CacheStorage_t* store, const char* pathname, SharedBuffer_t** buf, const int requestor);
+int readFileRangeHandler(CacheStorage_t* store, const char* pathname, const size_t offset, const size_t len, SharedBuffer_t** buf, const char** data, size_t* size, const int requestor);
 int readNFilesHandler(CacheStorage_t* store, const long upperLimit, void** buf, size_t* size, const int requestor);
 int writeToFileHandler(CacheStorage_t* store, const char* pathname, const char* newContent, const size_t newContentLen, struct fdNode** notifyList, FileNode_t** evictedList, const int requestor);
 int lockFileHandler(CacheStorage_t* store, const char* pathname, const int requestor);
@@ -79,6 +180,7 @@ int removeFileHandler(CacheStorage_t* store, const char* pathname, struct fdNode
 
 bool testFirstWrite(CacheStorage_t* store, const char* pathname, const int requestor);
 void deallocFile(FileNode_t* fptr);
+void retireFile(CacheStorage_t* store, FileNode_t* fptr);
 int clientExitHandler(CacheStorage_t* store, struct fdNode** notifyList, const int requestor);
 
 #endif
\ No newline at end of file
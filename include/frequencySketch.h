@@ -0,0 +1,17 @@
+#ifndef FREQUENCY_SKETCH_H
+#define FREQUENCY_SKETCH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define SKETCH_MAX_COUNT 15 /**< Counters saturate at this value */
+
+typedef struct _frequencySketch FrequencySketch;
+
+FrequencySketch* allocFrequencySketch(size_t expectedKeys);
+int destroyFrequencySketch(FrequencySketch* sketch);
+
+void frequencySketchIncrement(FrequencySketch* sketch, uint64_t hash);
+unsigned frequencySketchEstimate(const FrequencySketch* sketch, uint64_t hash);
+
+#endif
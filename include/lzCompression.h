@@ -0,0 +1,11 @@
+#ifndef LZ_COMPRESSION_H
+#define LZ_COMPRESSION_H
+
+#include <stdlib.h>
+
+#define LZ_MAX_COMPRESSED_SIZE(size) ((size) + (size) / 255 + 16) /**< Worst case size of the output of `LZcompress` */
+
+size_t LZcompress(const char* src, size_t size, char* dest);
+size_t LZdecompress(const char* src, size_t compressedSize, char* dest, size_t uncompressedSize);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef PARKING_LOT_H
+#define PARKING_LOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint8_t WordLock_t; /**< Mutex taking a single byte; zero-initialized means unlocked */
+typedef uint8_t WordCond_t; /**< Condition variable taking a single byte; zero-initialized means no waiters */
+
+void wordLock(WordLock_t* lock);
+bool wordTryLock(WordLock_t* lock);
+void wordUnlock(WordLock_t* lock);
+
+void wordCondWait(WordCond_t* cond, WordLock_t* lock);
+void wordCondBroadcast(WordCond_t* cond);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef REQ_CODE_H
 #define REQ_CODE_H
 
+#define READ_RANGE 0
 #define READ_N_FILES 1
 #define OPEN_FILE 2
 #define READ_FILE 3
@@ -8,5 +8,6 @@
 #define INTERNAL_SERVER_ERROR 5
 #define BAD_REQUEST 6
 #define ALREADY_EXISTS 7
+#define NOT_ADMITTED 8
 
 #endif
\ No newline at end of file
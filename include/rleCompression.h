@@ -1,7 +1,16 @@
 #ifndef RLE_COMPRESSION_H
 #define RLE_COMPRESSION_H
 
+#include <stdlib.h>
+
 char* RLEcompress(char* data, size_t origSize, size_t* compressedSize);
+size_t RLEcompressTo(char* data, size_t origSize, char* dest);
 char* RLEdecompress(char* data, size_t compressedSize, size_t uncompressedSize, size_t extraAllocation);
+size_t RLEdecompressTo(char* data, size_t compressedSize, size_t uncompressedSize, char* dest);
+
+#define RLE2_MAX_COMPRESSED_SIZE(size) ((size) + (size) / 64 + 16) /**< Worst case size of the output of `RLE2compressTo` */
+
+size_t RLE2compressTo(const char* data, size_t origSize, char* dest);
+size_t RLE2decompressTo(const char* data, size_t compressedSize, size_t uncompressedSize, char* dest);
 
 #endif
\ No newline at end of file
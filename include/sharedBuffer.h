@@ -0,0 +1,16 @@
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include <stdlib.h>
+
+typedef struct sharedBuffer {
+    size_t refs; /**< Only accessed atomically; the buffer is freed when the last reference is released */
+    size_t size;
+    char data[];
+} SharedBuffer_t;
+
+SharedBuffer_t* allocSharedBuffer(size_t size);
+void acquireSharedBuffer(SharedBuffer_t* buf);
+void releaseSharedBuffer(SharedBuffer_t* buf);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdlib.h>
+
+#define SLAB_SIZE ((size_t)64 * 1024) /**< Size (and alignment) of the blocks objects are carved from */
+
+typedef struct _slabAllocator SlabAllocator;
+
+SlabAllocator* allocSlabAllocator(size_t objSize);
+int destroySlabAllocator(SlabAllocator* allocator);
+
+void* slabAlloc(SlabAllocator* allocator);
+void slabFree(void* obj);
+size_t slabFootprint(SlabAllocator* allocator);
+
+#endif
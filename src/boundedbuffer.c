@@ -1,78 +1,191 @@
 /*! \file */
 
+#define _GNU_SOURCE
 
 #include "../include/boundedbuffer.h"
-#include "../utils/scerrhand.h"
-#include <pthread.h>
-#include <stdio.h>
-#include <assert.h>
+#include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #define MIN(a,b) (a) <= (b) ? (a) : (b)
 
-struct _node {
+#define CACHE_LINE_SIZE 64
+#define SPIN_LIMIT 128 /**< Number of failed attempts before a thread parks on the futex on SMP machines */
+
+#define CELL_AT(buf, pos) ((struct _cell*)((buf)->cells + ((pos) & (buf)->mask) * (buf)->cellSize))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#else
+#define CPU_RELAX()
+#endif
+
+struct _cell {
     /**
-    * @brief A buffer node.
+    * @brief A buffer slot. The element's data is stored right after the header, and every cell
+    * is padded to a multiple of the cache line size.
+    *
+    * `sequence` equals the slot's position when the slot is free for the producer that claims that position,
+    * and the position + 1 once the data has been published and can be consumed.
     */
 
-    void* data;
-    struct _node* nextPtr;
+    size_t sequence;
+    char data[];
+};
+
+struct _eventCount {
+    /**
+    * @brief A futex word threads can park on.
+    *
+    * The lowest bit is set by threads that are about to park; the other bits are a counter that is bumped
+    * (clearing the lowest bit) every time the parked threads are woken up. This way, threads that aren't
+    * parking never need to make a syscall.
+    */
+
+    int seq;
+    char pad[CACHE_LINE_SIZE - sizeof(int)];
 };
 
 struct _boundedBuffer {
     /**
-    * @brief A concurrent buffer with limited capacity.
+    * @brief A concurrent, lock-free buffer with limited capacity.
     */
 
-    size_t capacity; /**< Maximum number of elements that can be in the buffer at once */
-    size_t numElements; /**< Current number of elements in the buffer */
+    size_t capacity; /**< Maximum number of elements that can be in the buffer at once (a power of two) */
+    size_t mask; /**< `capacity - 1`, used to map a position to its cell */
     size_t dataSize; /**< Size of the data type of the elements in the buffer */
-    struct _node* headPtr; /**< Pointer to first element */
-    struct _node* tailPtr; /**< Pointer to last element */
-    pthread_mutex_t mutex; /**< A mutex for ensuring mutual exclusion access to the buffer */
-    pthread_cond_t empty; /**< Condition variable used to track whether the buffer is empty */
-    pthread_cond_t full; /**< Condition variable used to track whether the buffer is full */
+    size_t cellSize; /**< Size of a cell, including header and padding */
+    size_t spinLimit; /**< Number of failed attempts before a thread parks (0 on single-CPU machines) */
+    char* cells; /**< The ring of cells */
+
+    // positions and futex words each live on their own cache line to avoid false sharing
+    char pad0[CACHE_LINE_SIZE];
+    size_t enqueuePos; /**< Next position to be claimed by a producer */
+    char pad1[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t dequeuePos; /**< Next position to be claimed by a consumer */
+    char pad2[CACHE_LINE_SIZE - sizeof(size_t)];
+    struct _eventCount notEmpty; /**< Consumers park here while the buffer is empty */
+    struct _eventCount notFull; /**< Producers park here while the buffer is full */
 };
 
 
-static struct _node* _allocNode(void* data, size_t dataSize, size_t upTo) {
+static void _futexWait(int* addr, int val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void _futexWake(int* addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void _notify(struct _eventCount* ec) {
     /**
-    * @brief Allocates a new node for the bounded buffer, initializing its value to
-    * the given one, and returns it.
+    * @brief Wakes up the threads parked on `ec`, if any.
     *
-    * @param data A pointer to the data the new node is going to have
-    * @param dataSize The size of the data
-    * @param upTo If > 0, up to `upTo` bytes of data will be copied into the new node
-    *
-    * @return A pointer to the new node
-    * @return NULL if the node could not be allocated.
+    * @note The fence pairs with the atomic RMW in `_prepareWait`: either the parked threads see the element
+    * that was just published/consumed, or we see the waiters' bit.
     */
 
-    struct _node* newNode;
-    if (!(newNode = malloc(sizeof(*newNode)))) {
-        // malloc failed; return NULL to caller
-        return NULL;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int seq = __atomic_load_n(&ec->seq, __ATOMIC_RELAXED);
+    while (seq & 1) {
+        if (__atomic_compare_exchange_n(&ec->seq, &seq, seq + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            _futexWake(&ec->seq, INT_MAX);
+            break;
+        }
     }
+}
 
-    if (!(newNode->data = malloc(dataSize))) {
-        // malloc failed; return NULL to caller
-        return NULL;
+static int _prepareWait(struct _eventCount* ec) {
+    /**
+    * @brief Announces that the calling thread is about to park on `ec`.
+    *
+    * @return The value to pass to `_futexWait` if, after re-checking its condition, the thread still has to park
+    */
+
+    return __atomic_fetch_or(&ec->seq, 1, __ATOMIC_SEQ_CST) | 1;
+}
+
+static bool _tryEnqueue(BoundedBuffer* buf, void* data, size_t upTo) {
+    /**
+    * @brief Attempts to push the given data at the tail of the buffer without blocking.
+    *
+    * @return `true` on success, `false` if the buffer is full.
+    */
+
+    struct _cell* cell;
+    size_t pos = __atomic_load_n(&buf->enqueuePos, __ATOMIC_RELAXED);
+    while (true) {
+        cell = CELL_AT(buf, pos);
+        intptr_t diff = (intptr_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+        if (diff == 0) {
+            // cell is free: try to claim it
+            if (__atomic_compare_exchange_n(&buf->enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // the cell still holds an element from the previous lap: buffer is full
+            return false;
+        }
+        else {
+            // another producer claimed this position first
+            pos = __atomic_load_n(&buf->enqueuePos, __ATOMIC_RELAXED);
+        }
     }
 
-    // copy data into new node
-    memcpy(newNode->data, data, (upTo ? upTo : dataSize));
+    // copy data into the claimed cell and publish it
+    memcpy(cell->data, data, (upTo ? MIN(upTo, buf->dataSize) : buf->dataSize));
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
 
-    newNode->nextPtr = NULL;
+static bool _tryDequeue(BoundedBuffer* buf, void* dest, size_t destSize) {
+    /**
+    * @brief Attempts to pop the element at the head of the buffer without blocking.
+    *
+    * @return `true` on success, `false` if the buffer is empty.
+    */
 
-    return newNode;
+    struct _cell* cell;
+    size_t pos = __atomic_load_n(&buf->dequeuePos, __ATOMIC_RELAXED);
+    while (true) {
+        cell = CELL_AT(buf, pos);
+        intptr_t diff = (intptr_t)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            // cell holds a published element: try to claim it
+            if (__atomic_compare_exchange_n(&buf->dequeuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // nothing has been published at this position yet: buffer is empty
+            return false;
+        }
+        else {
+            // another consumer claimed this position first
+            pos = __atomic_load_n(&buf->dequeuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (dest) {
+        // copy cell data to destination
+        memcpy(dest, cell->data, MIN(buf->dataSize, destSize));
+    }
+    // hand the cell over to the producer of the next lap
+    __atomic_store_n(&cell->sequence, pos + buf->mask + 1, __ATOMIC_RELEASE);
+    return true;
 }
 
 
 BoundedBuffer* allocBoundedBuffer(size_t capacity, size_t dataSize) {
     /**
     * @brief Initializes and returns a new empty buffer with the given capacity.
-    * @param capacity Maximum capacity of the buffer
+    * @param capacity Maximum capacity of the buffer (rounded up to the next power of two)
     * @param dataSize Size of the elements in the buffer
     * @return A pointer to the newly created buffer upon success, NULL on error (sets `errno`)
     *
@@ -81,33 +194,38 @@ BoundedBuffer* allocBoundedBuffer(size_t capacity, size_t dataSize) {
     * `EINVAL`: invalid parameter(s) were passed
     */
 
-    if (capacity <= 0) {
+    if (capacity <= 0 || dataSize <= 0) {
         errno = EINVAL;
         return NULL;
     }
 
-    BoundedBuffer* buf = malloc(sizeof(BoundedBuffer));
-    if (!buf) { // malloc failed; return NULL to caller
+    BoundedBuffer* buf;
+    if (posix_memalign((void**)&buf, CACHE_LINE_SIZE, sizeof(BoundedBuffer))) {
         errno = ENOMEM;
         return NULL;
     }
+    memset(buf, 0, sizeof(*buf));
 
-    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-    pthread_cond_t full;
-    pthread_cond_t empty;
+    buf->capacity = 2;
+    while (buf->capacity < capacity) {
+        buf->capacity <<= 1;
+    }
+    buf->mask = buf->capacity - 1;
+    buf->dataSize = dataSize;
+    // spinning only makes sense if the thread we're waiting for can run at the same time
+    buf->spinLimit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? SPIN_LIMIT : 0;
+    // round the cell size up to a multiple of the cache line size
+    buf->cellSize = (sizeof(struct _cell) + dataSize + CACHE_LINE_SIZE - 1) & ~((size_t)CACHE_LINE_SIZE - 1);
 
-    // initialize condition variables
-    DIE_ON_NZ(pthread_cond_init(&full, NULL));
-    DIE_ON_NZ(pthread_cond_init(&empty, NULL));
+    if (posix_memalign((void**)&buf->cells, CACHE_LINE_SIZE, buf->capacity * buf->cellSize)) {
+        free(buf);
+        errno = ENOMEM;
+        return NULL;
+    }
 
-    buf->capacity = capacity;
-    buf->dataSize = dataSize;
-    buf->numElements = 0;
-    buf->headPtr = NULL;
-    buf->tailPtr = NULL;
-    buf->mutex = mutex;
-    buf->empty = empty;
-    buf->full = full;
+    for (size_t i = 0; i < buf->capacity; i++) {
+        CELL_AT(buf, i)->sequence = i;
+    }
 
     return buf;
 }
@@ -115,10 +233,10 @@ BoundedBuffer* allocBoundedBuffer(size_t capacity, size_t dataSize) {
 
 int dequeue(BoundedBuffer* buf, void* dest, size_t destSize) {
     /**
-    * @brief Pops the node at the head of the buffer and returns its value.
+    * @brief Pops the element at the head of the buffer and returns its value.
     * If the buffer is empty, waits until there is at least one element in it.
     *
-    * @param buf A pointer to the buffer from which to dequeue the node
+    * @param buf A pointer to the buffer from which to dequeue the element
     * @param dest A pointer to a location to save the popped data. Can be NULL if data isn't to
     * be saved but rather just destroyed
     *
@@ -135,40 +253,26 @@ int dequeue(BoundedBuffer* buf, void* dest, size_t destSize) {
         return -1;
     }
 
-
-    DIE_ON_NZ(pthread_mutex_lock(&(buf->mutex))); // gain mutual exclusion access
-
-    while (buf->numElements == 0) { // buffer is empty: wait
-        DIE_ON_NZ(pthread_cond_wait(&(buf->empty), &(buf->mutex)));
-    }
-
-    struct _node* node = buf->headPtr; // get buffer head node
-    if (dest) {
-        // copy node data to destination
-        memcpy(dest, node->data, MIN(buf->dataSize, destSize));
+    for (size_t attempt = 0; !_tryDequeue(buf, dest, destSize); attempt++) {
+        if (attempt < buf->spinLimit) {
+            CPU_RELAX();
+            continue;
+        }
+        // buffer is empty: park until a producer publishes an element
+        int seq = _prepareWait(&buf->notEmpty);
+        if (_tryDequeue(buf, dest, destSize)) {
+            break;
+        }
+        _futexWait(&buf->notEmpty.seq, seq);
     }
-    buf->headPtr = node->nextPtr;
-    buf->numElements--;
-
-    if (buf->numElements == 0) {
-        buf->tailPtr = NULL;
-    }
-
-    if (buf->numElements == buf->capacity - 1) { // buffer was full before we dequeued
-        DIE_ON_NZ(pthread_cond_broadcast(&(buf->full))); // wake up a producer thread (if any)
-    }
-
-    DIE_ON_NZ(pthread_mutex_unlock(&(buf->mutex))); // waive mutual exclusion access
 
-    // done outside of critical section to avoid doing costly syscalls in mutual exclusion uselessly
-    free(node->data);
-    free(node);
+    _notify(&buf->notFull); // wake up parked producer threads (if any)
     return 0;
 }
 
 int destroyBoundedBuffer(BoundedBuffer* buf) {
     /**
-    * @brief Frees every remaining element in the buffer, then frees the buffer.
+    * @brief Frees the buffer, discarding any remaining element.
     * @param buf Pointer to the buffer to free
     *
     * @return 0 on success, -1 on error (sets `errno`)
@@ -182,72 +286,73 @@ int destroyBoundedBuffer(BoundedBuffer* buf) {
         return -1;
     }
 
-    while (buf->numElements) {
-        dequeue(buf, NULL, 0);
-    }
-
-    assert(&buf->empty);
-    DIE_ON_NZ(pthread_cond_destroy(&buf->empty));
-
-    assert(&buf->full);
-    DIE_ON_NZ(pthread_cond_destroy(&buf->full));
-
-    assert(&buf->mutex);
-    DIE_ON_NZ(pthread_mutex_destroy(&buf->mutex));
-
+    free(buf->cells);
     free(buf);
     return 0;
 }
 
-int enqueue(BoundedBuffer* buf, void* data, size_t upTo) {
+int tryEnqueue(BoundedBuffer* buf, void* data, size_t upTo) {
     /**
-    * @brief Allocates a new node with the given value and pushes it to the tail
-    * of the bounded buffer. If the buffer is full, waits until there is at least one free spot.
+    * @brief Copies the given value into a free slot at the tail of the bounded buffer, unless the buffer is full.
+    * Unlike `enqueue`, never waits.
     *
     * @param buf is the buffer the data is going to be pushed to
     * @param data is a pointer to the data to be pushed
-    * @param upTo If > 0, up to `upTo` bytes of data will be copied into the new node
+    * @param upTo If > 0, up to `upTo` bytes of data will be copied into the slot
     *
     * @return 0 on success, -1 on error (sets `errno`)
     *
     * Upon error, `errno` will have one of the following values:\n
-    * `ENOMEM`: memory for the new node couldn't be allocated\n
+    * `EAGAIN`: the buffer is full\n
     * `EINVAL`: invalid parameter(s) were passed
     */
 
-
     if (!buf || !data) {
         errno = EINVAL;
         return -1;
     }
-
-    // allocate new node outside of critical section to keep it as short as possible
-    struct _node* newNode = _allocNode(data, buf->dataSize, upTo);
-
-    if (!newNode) { // malloc failed; return -1 to caller
-        errno = ENOMEM;
+    if (!_tryEnqueue(buf, data, upTo)) {
+        errno = EAGAIN;
         return -1;
     }
-    DIE_ON_NZ(pthread_mutex_lock(&(buf->mutex))); // gain mutual exclusion access
+    _notify(&buf->notEmpty); // wake up parked consumer threads (if any)
+    return 0;
+}
 
-    while (buf->numElements == buf->capacity) { // buffer is full: wait
-        DIE_ON_NZ(pthread_cond_wait(&(buf->full), &(buf->mutex)));
-    }
+int enqueue(BoundedBuffer* buf, void* data, size_t upTo) {
+    /**
+    * @brief Copies the given value into a free slot at the tail of the bounded buffer.
+    * If the buffer is full, waits until there is at least one free spot.
+    *
+    * @param buf is the buffer the data is going to be pushed to
+    * @param data is a pointer to the data to be pushed
+    * @param upTo If > 0, up to `upTo` bytes of data will be copied into the slot
+    *
+    * @return 0 on success, -1 on error (sets `errno`)
+    *
+    * Upon error, `errno` will have one of the following values:\n
+    * `EINVAL`: invalid parameter(s) were passed
+    */
 
-    if (buf->numElements) {
-        buf->tailPtr->nextPtr = newNode;
-    }
-    else {
-        buf->headPtr = newNode;
-    }
-    buf->tailPtr = newNode;
-    buf->numElements++;
 
-    if (buf->numElements == 1) { // buffer was empty before we enqueued
-        DIE_ON_NZ(pthread_cond_broadcast(&(buf->empty))); // wake up a consumer thread (if any)
+    if (!buf || !data) {
+        errno = EINVAL;
+        return -1;
     }
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(buf->mutex))); // waive mutual exclusion access
+    for (size_t attempt = 0; !_tryEnqueue(buf, data, upTo); attempt++) {
+        if (attempt < buf->spinLimit) {
+            CPU_RELAX();
+            continue;
+        }
+        // buffer is full: park until a consumer frees a slot
+        int seq = _prepareWait(&buf->notFull);
+        if (_tryEnqueue(buf, data, upTo)) {
+            break;
+        }
+        _futexWait(&buf->notFull.seq, seq);
+    }
 
+    _notify(&buf->notEmpty); // wake up parked consumer threads (if any)
     return 0;
 }
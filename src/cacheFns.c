@@ -1,13 +1,24 @@
 #include "../include/cacheFns.h"
 #include "../include/filesystemApi.h"
+#include "../utils/scerrhand.h"
+#include <errno.h>
+#include <stdio.h>
 
 /**
- * Defines comparator functions used by the cache heap to determine the files
- * to evict.
+ * Defines the replacement algorithms used by the storage to determine the files
+ * to evict, and the comparator functions used to choose among the victims proposed
+ * by different shards.
  */
 
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+#define LFU_AGING_PERIOD 16 /**< With LFU, ref counts of a shard are halved every `LFU_AGING_PERIOD` accesses per file */
+
 int lru_cmp(const void* f1, const void* f2) {
-    return ((FileNode_t*)f2)->lastRef - ((FileNode_t*)f1)->lastRef;
+    // the clock's ticks don't fit in an int, so they can't be subtracted
+    const uint64_t t1 = ((FileNode_t*)f1)->lastRef, t2 = ((FileNode_t*)f2)->lastRef;
+    return (t2 > t1) - (t2 < t1);
 }
 
 int lfu_cmp(const void* f1, const void* f2) {
@@ -15,7 +26,744 @@ int lfu_cmp(const void* f1, const void* f2) {
 }
 
 int fifo_cmp(const void* f1, const void* f2) {
-    return ((FileNode_t*)f2)->insertionTime - ((FileNode_t*)f1)->insertionTime;
+    const uint64_t t1 = ((FileNode_t*)f1)->insertionTime, t2 = ((FileNode_t*)f2)->insertionTime;
+    return (t2 > t1) - (t2 < t1);
+}
+
+int arc_cmp(const void* f1, const void* f2) {
+    // files used once are evicted before files used more than once, whichever shard they're in: otherwise a shard
+    // with no files used once would give up a frequently used file while other shards are full of scanned ones
+    const bool frequent1 = __atomic_load_n(&(((FileNode_t*)f1)->arcFrequent), __ATOMIC_RELAXED);
+    const bool frequent2 = __atomic_load_n(&(((FileNode_t*)f2)->arcFrequent), __ATOMIC_RELAXED);
+    if (frequent1 != frequent2) {
+        return frequent1 ? -1 : 1;
+    }
+    return lru_cmp(f1, f2);
+}
+
+
+typedef struct evictionList {
+    /**
+     * @brief An intrusive list of files, linked through their `evictPrev` and `evictNext` fields.
+     */
+    FileNode_t* hPtr; /**< File to be evicted first */
+    FileNode_t* tPtr;
+    size_t len;
+} EvictionList_t;
+
+static void listUnlink(EvictionList_t* list, FileNode_t* fptr) {
+    if (fptr->evictPrev) {
+        fptr->evictPrev->evictNext = fptr->evictNext;
+    }
+    else {
+        list->hPtr = fptr->evictNext;
+    }
+    if (fptr->evictNext) {
+        fptr->evictNext->evictPrev = fptr->evictPrev;
+    }
+    else {
+        list->tPtr = fptr->evictPrev;
+    }
+    fptr->evictPrev = fptr->evictNext = NULL;
+    list->len -= 1;
+}
+
+static void listLinkAfter(EvictionList_t* list, FileNode_t* fptr, FileNode_t* after) {
+    /**
+     * @brief Links the file right after `after`, or at the head of the list if `after` is NULL.
+     */
+    fptr->evictPrev = after;
+    fptr->evictNext = after ? after->evictNext : list->hPtr;
+    if (fptr->evictNext) {
+        fptr->evictNext->evictPrev = fptr;
+    }
+    else {
+        list->tPtr = fptr;
+    }
+    if (after) {
+        after->evictNext = fptr;
+    }
+    else {
+        list->hPtr = fptr;
+    }
+    list->len += 1;
+}
+
+static FileNode_t* listFirstEvictable(const EvictionList_t* list, IsEvictableFn_t isEvictable, void* arg) {
+    FileNode_t* currPtr = list->hPtr;
+    while (currPtr && !isEvictable(currPtr, arg)) {
+        currPtr = currPtr->evictNext;
+    }
+    return currPtr;
+}
+
+
+// FIFO and LRU: a single list, in order of insertion (FIFO) or of last use (LRU)
+
+static void* listAllocState(void* shared) {
+    (void)shared; // FIFO and LRU don't share anything between shards
+    EvictionList_t* list = calloc(1, sizeof(*list));
+    if (!list) {
+        errno = ENOMEM;
+    }
+    return list;
 }
 
-int (*cmp_fns[3])(const void* f1, const void* f2) = { fifo_cmp, lru_cmp, lfu_cmp };
+static void listDestroyState(void* state) {
+    free(state);
+}
+
+static void listOnInsert(void* state, FileNode_t* fptr) {
+    EvictionList_t* list = state;
+    listLinkAfter(list, fptr, list->tPtr);
+}
+
+static void lruOnAccess(void* state, FileNode_t* fptr) {
+    // the file becomes the last one to be evicted
+    EvictionList_t* list = state;
+    if (list->tPtr != fptr) {
+        listUnlink(list, fptr);
+        listLinkAfter(list, fptr, list->tPtr);
+    }
+}
+
+static void listOnRemove(void* state, FileNode_t* fptr, bool evicted) {
+    (void)evicted; // files leave the order the same way whether they're evicted or removed
+    listUnlink(state, fptr);
+}
+
+static FileNode_t* listPickVictim(void* state, IsEvictableFn_t isEvictable, void* arg) {
+    return listFirstEvictable(state, isEvictable, arg);
+}
+
+
+// LFU: the list is sorted by ref count, and files with the same ref count are grouped in a bucket
+
+typedef struct lfuBucket {
+    size_t refCount; /**< Ref count shared by all the files in the bucket */
+    FileNode_t* first; /**< Files of the bucket are contiguous in the list, from `first` to `last` */
+    FileNode_t* last;
+
+    struct lfuBucket* prevPtr; /**< Bucket with the closest lower ref count */
+    struct lfuBucket* nextPtr; /**< Bucket with the closest higher ref count */
+} LfuBucket_t;
+
+typedef struct lfuState {
+    EvictionList_t order;
+    LfuBucket_t* hPtr; /**< Bucket with the lowest ref count */
+    size_t accesses; /**< Number of accesses since the ref counts were last halved */
+} LfuState_t;
+
+#define BUCKET_OF(fptr) ((LfuBucket_t*)(fptr)->evictionData)
+
+static void* lfuAllocState(void* shared) {
+    (void)shared;
+    LfuState_t* state = calloc(1, sizeof(*state));
+    if (!state) {
+        errno = ENOMEM;
+    }
+    return state;
+}
+
+static void lfuDestroyState(void* state) {
+    free(state);
+}
+
+static LfuBucket_t* allocLfuBucket(LfuState_t* state, LfuBucket_t* after, size_t refCount) {
+    /**
+     * @brief Creates an empty bucket and links it right after `after`, or at the head of the bucket list if `after` is NULL.
+     */
+    LfuBucket_t* bucket;
+    DIE_ON_NULL((bucket = calloc(1, sizeof(*bucket))));
+    bucket->refCount = refCount;
+    bucket->prevPtr = after;
+    bucket->nextPtr = after ? after->nextPtr : state->hPtr;
+    if (bucket->nextPtr) {
+        bucket->nextPtr->prevPtr = bucket;
+    }
+    if (after) {
+        after->nextPtr = bucket;
+    }
+    else {
+        state->hPtr = bucket;
+    }
+    return bucket;
+}
+
+static void destroyLfuBucket(LfuState_t* state, LfuBucket_t* bucket) {
+    if (bucket->prevPtr) {
+        bucket->prevPtr->nextPtr = bucket->nextPtr;
+    }
+    else {
+        state->hPtr = bucket->nextPtr;
+    }
+    if (bucket->nextPtr) {
+        bucket->nextPtr->prevPtr = bucket->prevPtr;
+    }
+    free(bucket);
+}
+
+static void removeFromLfuBucket(LfuState_t* state, FileNode_t* fptr) {
+    /**
+     * @brief Takes the file out of its bucket (destroying the bucket if it becomes empty) and out of the list.
+     */
+    LfuBucket_t* bucket = BUCKET_OF(fptr);
+    if (bucket->first == fptr && bucket->last == fptr) {
+        destroyLfuBucket(state, bucket);
+    }
+    else if (bucket->first == fptr) {
+        bucket->first = fptr->evictNext;
+    }
+    else if (bucket->last == fptr) {
+        bucket->last = fptr->evictPrev;
+    }
+    fptr->evictionData = NULL;
+    listUnlink(&(state->order), fptr);
+}
+
+static void ageLfuBuckets(LfuState_t* state) {
+    /**
+     * @brief Halves the ref count of every file in the shard, so that files that used to be popular \n
+     * but aren't being used anymore eventually become eligible for eviction.
+     *
+     * Buckets whose halved counts are the same are merged: since the buckets are contiguous and sorted \n
+     * in the list, merging them doesn't require moving any file.
+     */
+    LfuBucket_t* bucket = state->hPtr;
+    while (bucket) {
+        LfuBucket_t* next = bucket->nextPtr;
+        bucket->refCount /= 2;
+        if (bucket->prevPtr && bucket->prevPtr->refCount == bucket->refCount) {
+            LfuBucket_t* merged = bucket->prevPtr;
+            merged->last = bucket->last;
+            destroyLfuBucket(state, bucket);
+            bucket = merged;
+        }
+        for (FileNode_t* currPtr = bucket->first; ; currPtr = currPtr->evictNext) {
+            currPtr->refCount = bucket->refCount;
+            currPtr->evictionData = bucket;
+            if (currPtr == bucket->last) {
+                break;
+            }
+        }
+        bucket = next;
+    }
+    state->accesses = 0;
+}
+
+static void lfuOnInsert(void* statePtr, FileNode_t* fptr) {
+    // new files go after the other files that have never been used
+    LfuState_t* state = statePtr;
+    LfuBucket_t* bucket = state->hPtr;
+    if (!bucket || bucket->refCount != fptr->refCount) {
+        bucket = allocLfuBucket(state, NULL, fptr->refCount);
+        listLinkAfter(&(state->order), fptr, NULL);
+        bucket->first = fptr;
+    }
+    else {
+        listLinkAfter(&(state->order), fptr, bucket->last);
+    }
+    bucket->last = fptr;
+    fptr->evictionData = bucket;
+}
+
+static void lfuOnAccess(void* statePtr, FileNode_t* fptr) {
+    /**
+     * @brief Moves the file from its bucket to the one for the next ref count, creating it if needed. \n
+     * Within a bucket, files are kept in the order they entered it, so ties are broken in LRU order.
+     */
+    LfuState_t* state = statePtr;
+    LfuBucket_t* bucket = BUCKET_OF(fptr);
+    LfuBucket_t* next = bucket->nextPtr;
+    fptr->refCount += 1;
+
+    if (next && next->refCount == fptr->refCount) {
+        removeFromLfuBucket(state, fptr);
+        listLinkAfter(&(state->order), fptr, next->last);
+        next->last = fptr;
+        fptr->evictionData = next;
+    }
+    else if (bucket->first == fptr && bucket->last == fptr) {
+        // the file is alone in its bucket: it can keep it
+        bucket->refCount = fptr->refCount;
+    }
+    else {
+        removeFromLfuBucket(state, fptr);
+        next = allocLfuBucket(state, bucket, fptr->refCount);
+        listLinkAfter(&(state->order), fptr, bucket->last);
+        next->first = next->last = fptr;
+        fptr->evictionData = next;
+    }
+
+    state->accesses += 1;
+    if (state->accesses >= LFU_AGING_PERIOD * state->order.len) {
+        ageLfuBuckets(state);
+    }
+}
+
+static void lfuOnRemove(void* state, FileNode_t* fptr, bool evicted) {
+    (void)evicted;
+    removeFromLfuBucket(state, fptr);
+}
+
+static FileNode_t* lfuPickVictim(void* state, IsEvictableFn_t isEvictable, void* arg) {
+    return listFirstEvictable(&(((LfuState_t*)state)->order), isEvictable, arg);
+}
+
+
+// ARC: files that have been used once since they entered the storage are kept apart from the ones that
+// have been used more than once, and the storage adapts how many of each to keep by remembering the
+// pathnames of the files it recently evicted from either group ("ghosts")
+
+typedef struct arcGhost {
+    char* pathname;
+    uint64_t pathHash;
+    struct ghostList* list; /**< Ghost list the entry belongs to */
+    struct arcGhost* prevPtr;
+    struct arcGhost* nextPtr;
+} ArcGhost_t;
+
+typedef struct ghostList {
+    ArcGhost_t* hPtr; /**< Least recently evicted ghost */
+    ArcGhost_t* tPtr;
+    size_t len;
+} GhostList_t;
+
+typedef struct arcState {
+    EvictionList_t recent; /**< Files used once since they entered the storage, least recently used first (T1) */
+    EvictionList_t frequent; /**< Files used more than once, least recently used first (T2) */
+    GhostList_t recentGhosts; /**< Pathnames of files recently evicted from `recent` (B1) */
+    GhostList_t frequentGhosts; /**< Pathnames of files recently evicted from `frequent` (B2) */
+    FileIndex* ghostIndex; /**< Looks up ghosts by pathname */
+    size_t target; /**< Number of files `recent` should hold (p) */
+} ArcState_t;
+
+#define LIST_OF(fptr) ((EvictionList_t*)(fptr)->evictionData)
+// ARC's cache size is the number of files the shard holds at the moment, as its capacity is also limited by size
+#define ARC_CAPACITY(state) MAX((state)->recent.len + (state)->frequent.len, 1)
+
+static void* arcAllocState(void* shared) {
+    (void)shared;
+    ArcState_t* state = calloc(1, sizeof(*state));
+    if (!state) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (!(state->ghostIndex = allocFileIndex(0, NULL))) {
+        free(state);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return state;
+}
+
+static void dropGhost(ArcState_t* state, ArcGhost_t* ghost) {
+    GhostList_t* list = ghost->list;
+    if (ghost->prevPtr) {
+        ghost->prevPtr->nextPtr = ghost->nextPtr;
+    }
+    else {
+        list->hPtr = ghost->nextPtr;
+    }
+    if (ghost->nextPtr) {
+        ghost->nextPtr->prevPtr = ghost->prevPtr;
+    }
+    else {
+        list->tPtr = ghost->prevPtr;
+    }
+    list->len -= 1;
+
+    fileIndexRemove(state->ghostIndex, ghost->pathname, ghost->pathHash);
+    free(ghost->pathname);
+    free(ghost);
+}
+
+static void arcDestroyState(void* statePtr) {
+    ArcState_t* state = statePtr;
+    while (state->recentGhosts.hPtr) {
+        dropGhost(state, state->recentGhosts.hPtr);
+    }
+    while (state->frequentGhosts.hPtr) {
+        dropGhost(state, state->frequentGhosts.hPtr);
+    }
+    destroyFileIndex(state->ghostIndex);
+    free(state);
+}
+
+static void arcOnInsert(void* statePtr, FileNode_t* fptr) {
+    /**
+     * @brief New files go to `recent`, unless they have been evicted recently: in that case they \n
+     * go to `frequent`, and the target size of `recent` is adjusted in favour of the list they were evicted from.
+     */
+    ArcState_t* state = statePtr;
+    ArcGhost_t* ghost = fileIndexFind(state->ghostIndex, fptr->pathname, fptr->pathHash);
+    EvictionList_t* list = &(state->recent);
+
+    if (ghost) {
+        list = &(state->frequent);
+    }
+    listLinkAfter(list, fptr, list->tPtr);
+    fptr->evictionData = list;
+    __atomic_store_n(&(fptr->arcFrequent), (list == &(state->frequent)), __ATOMIC_RELAXED);
+
+    if (ghost) {
+        const size_t recentGhosts = state->recentGhosts.len, frequentGhosts = state->frequentGhosts.len;
+        if (ghost->list == &(state->recentGhosts)) {
+            // `recent` was too small
+            state->target = MIN(state->target + MAX(frequentGhosts / recentGhosts, 1), ARC_CAPACITY(state));
+        }
+        else {
+            // `frequent` was too small
+            state->target -= MIN(state->target, MAX(recentGhosts / frequentGhosts, 1));
+        }
+        dropGhost(state, ghost);
+    }
+}
+
+static void arcOnAccess(void* statePtr, FileNode_t* fptr) {
+    /**
+     * @brief Moves the file at the tail of `frequent` if it's being used again, or of `recent` if it's still \n
+     * being used by the requests that created it.
+     *
+     * @note Every request on a file counts as a use, hence a file only counts as used more than once after it \n
+     * has been opened again since it was created: otherwise writing a file would be enough to make it frequent.
+     */
+    ArcState_t* state = statePtr;
+    EvictionList_t* list = (fptr->numOpens > 1) ? &(state->frequent) : LIST_OF(fptr);
+
+    if (list->tPtr != fptr) {
+        listUnlink(LIST_OF(fptr), fptr);
+        listLinkAfter(list, fptr, list->tPtr);
+        fptr->evictionData = list;
+        __atomic_store_n(&(fptr->arcFrequent), (list == &(state->frequent)), __ATOMIC_RELAXED);
+    }
+}
+
+static void arcOnRemove(void* statePtr, FileNode_t* fptr, bool evicted) {
+    /**
+     * @brief Unlinks the file and, if it has been evicted, remembers its pathname in the ghost list \n
+     * corresponding to the list it was evicted from. Ghost lists are trimmed so that `recent` and its ghosts \n
+     * don't outnumber the cache size, and all the lists together don't outnumber twice the cache size.
+     */
+    ArcState_t* state = statePtr;
+    EvictionList_t* list = LIST_OF(fptr);
+    listUnlink(list, fptr);
+    fptr->evictionData = NULL;
+
+    if (!evicted) {
+        return;
+    }
+
+    GhostList_t* ghostList = (list == &(state->recent)) ? &(state->recentGhosts) : &(state->frequentGhosts);
+    ArcGhost_t* ghost;
+    DIE_ON_NULL((ghost = calloc(1, sizeof(*ghost))));
+    const size_t pathLen = strlen(fptr->pathname) + 1;
+    DIE_ON_NULL((ghost->pathname = malloc(pathLen)));
+    memcpy(ghost->pathname, fptr->pathname, pathLen);
+    ghost->pathHash = fptr->pathHash;
+    ghost->list = ghostList;
+    ghost->prevPtr = ghostList->tPtr;
+    if (ghostList->tPtr) {
+        ghostList->tPtr->nextPtr = ghost;
+    }
+    else {
+        ghostList->hPtr = ghost;
+    }
+    ghostList->tPtr = ghost;
+    ghostList->len += 1;
+    DIE_ON_NEG_ONE(fileIndexInsert(state->ghostIndex, ghost->pathname, ghost->pathHash, ghost));
+
+    const size_t capacity = ARC_CAPACITY(state);
+    while (state->recentGhosts.len && state->recent.len + state->recentGhosts.len > capacity) {
+        dropGhost(state, state->recentGhosts.hPtr);
+    }
+    while (state->recentGhosts.len + state->frequentGhosts.len > capacity) {
+        dropGhost(state, state->frequentGhosts.len ? state->frequentGhosts.hPtr : state->recentGhosts.hPtr);
+    }
+}
+
+static FileNode_t* arcPickVictim(void* statePtr, IsEvictableFn_t isEvictable, void* arg) {
+    /**
+     * @brief Evicts the least recently used file of `recent` if it holds more files than its target size, \n
+     * otherwise the least recently used file of `frequent`.
+     */
+    ArcState_t* state = statePtr;
+    FileNode_t* recentVictim = listFirstEvictable(&(state->recent), isEvictable, arg);
+    FileNode_t* frequentVictim = listFirstEvictable(&(state->frequent), isEvictable, arg);
+
+    if (recentVictim && (state->recent.len > state->target || !frequentVictim)) {
+        return recentVictim;
+    }
+    return frequentVictim;
+}
+
+
+// GDSF: files are evicted in order of priority, which grows with the number of times they've been used and
+// shrinks with their size. An inflation value, raised to the priority of every evicted file, is added to the
+// priority of files as they are inserted or used, so that files that stop being used eventually become victims
+
+typedef struct gdsfShared {
+    double inflation; /**< Only accessed atomically; priority of the most recently evicted file (L) */
+    long target; /**< `GDSF_OBJECT_HIT_RATIO` or `GDSF_BYTE_HIT_RATIO` */
+} GdsfShared_t;
+
+typedef struct gdsfState {
+    GdsfShared_t* shared;
+    FileNode_t** heap; /**< Binary min-heap of the shard's files, keyed by priority */
+    size_t len;
+    size_t capacity;
+} GdsfState_t;
+
+#define GDSF_INITIAL_HEAP_CAPACITY 16
+#define GDSF_MAX_PROBES 64 /**< Max number of files of a shard looked at when searching for an evictable one */
+
+int gdsf_cmp(const void* f1, const void* f2) {
+    const double p1 = ((FileNode_t*)f1)->priority, p2 = ((FileNode_t*)f2)->priority;
+    return (p1 < p2) - (p1 > p2);
+}
+
+static bool gdsfPrecedes(const FileNode_t* f1, const FileNode_t* f2) {
+    const int cmp = gdsf_cmp(f1, f2);
+    return cmp > 0 || (cmp == 0 && f1->insertionSeq < f2->insertionSeq);
+}
+
+static void* gdsfAllocShared(long option) {
+    if (option != GDSF_OBJECT_HIT_RATIO && option != GDSF_BYTE_HIT_RATIO) {
+        errno = EINVAL;
+        return NULL;
+    }
+    GdsfShared_t* shared = calloc(1, sizeof(*shared));
+    if (!shared) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    shared->target = option;
+    return shared;
+}
+
+static void gdsfDestroyShared(void* shared) {
+    free(shared);
+}
+
+static void* gdsfAllocState(void* shared) {
+    GdsfState_t* state = calloc(1, sizeof(*state));
+    if (!state || !(state->heap = malloc(GDSF_INITIAL_HEAP_CAPACITY * sizeof(*(state->heap))))) {
+        free(state);
+        errno = ENOMEM;
+        return NULL;
+    }
+    state->shared = shared;
+    state->capacity = GDSF_INITIAL_HEAP_CAPACITY;
+    return state;
+}
+
+static void gdsfDestroyState(void* statePtr) {
+    GdsfState_t* state = statePtr;
+    free(state->heap);
+    free(state);
+}
+
+static void heapPlace(GdsfState_t* state, FileNode_t* fptr, size_t idx) {
+    state->heap[idx] = fptr;
+    fptr->heapIdx = idx;
+}
+
+static void heapFix(GdsfState_t* state, size_t idx) {
+    /**
+     * @brief Restores the heap property after the priority of the file at position `idx` changed.
+     */
+    FileNode_t* fptr = state->heap[idx];
+    while (idx > 0 && gdsfPrecedes(fptr, state->heap[(idx - 1) / 2])) {
+        heapPlace(state, state->heap[(idx - 1) / 2], idx);
+        idx = (idx - 1) / 2;
+    }
+    while (2 * idx + 1 < state->len) {
+        size_t child = 2 * idx + 1;
+        if (child + 1 < state->len && gdsfPrecedes(state->heap[child + 1], state->heap[child])) {
+            child += 1;
+        }
+        if (!gdsfPrecedes(state->heap[child], fptr)) {
+            break;
+        }
+        heapPlace(state, state->heap[child], idx);
+        idx = child;
+    }
+    heapPlace(state, fptr, idx);
+}
+
+static void gdsfUpdatePriority(GdsfState_t* state, FileNode_t* fptr) {
+    double inflation;
+    __atomic_load(&(state->shared->inflation), &inflation, __ATOMIC_RELAXED);
+    const double size = MAX(fptr->contentSize, 1);
+    const double cost = (state->shared->target == GDSF_BYTE_HIT_RATIO) ? size : 1;
+    fptr->priority = inflation + (fptr->refCount + 1) * cost / size;
+}
+
+static void gdsfOnInsert(void* statePtr, FileNode_t* fptr) {
+    GdsfState_t* state = statePtr;
+    if (state->len == state->capacity) {
+        state->capacity *= 2;
+        DIE_ON_NULL((state->heap = realloc(state->heap, state->capacity * sizeof(*(state->heap)))));
+    }
+    gdsfUpdatePriority(state, fptr);
+    heapPlace(state, fptr, state->len);
+    state->len += 1;
+    heapFix(state, state->len - 1);
+}
+
+static void gdsfOnAccess(void* statePtr, FileNode_t* fptr) {
+    GdsfState_t* state = statePtr;
+    fptr->refCount += 1;
+    gdsfUpdatePriority(state, fptr);
+    heapFix(state, fptr->heapIdx);
+}
+
+static void gdsfOnRemove(void* statePtr, FileNode_t* fptr, bool evicted) {
+    GdsfState_t* state = statePtr;
+
+    if (evicted) {
+        // evictions are serialized, and victims are chosen in order of priority across all shards
+        double inflation;
+        __atomic_load(&(state->shared->inflation), &inflation, __ATOMIC_RELAXED);
+        if (fptr->priority > inflation) {
+            __atomic_store(&(state->shared->inflation), &(fptr->priority), __ATOMIC_RELAXED);
+        }
+    }
+
+    state->len -= 1;
+    if (fptr->heapIdx != state->len) {
+        heapPlace(state, state->heap[state->len], fptr->heapIdx);
+        heapFix(state, fptr->heapIdx);
+    }
+}
+
+static void gdsfOnResize(void* statePtr, FileNode_t* fptr) {
+    // the priority is recomputed as of the last use: only the size changed, not how many times the file has been used
+    GdsfState_t* state = statePtr;
+    gdsfUpdatePriority(state, fptr);
+    heapFix(state, fptr->heapIdx);
+}
+
+static FileNode_t* gdsfPickVictim(void* statePtr, IsEvictableFn_t isEvictable, void* arg) {
+    /**
+     * @brief Returns the evictable file with the lowest priority, looking at files in order of priority.
+     * @details A file has a lower priority than all of its descendants in the heap, so they only need to be \n
+     * looked at if it can't be evicted: the files that could be next are kept in a small heap of their own \n
+     * (the frontier), which starts from the root. Since only the files that are being used can't be evicted, \n
+     * the search gives up after `GDSF_MAX_PROBES` files rather than going through the whole shard.
+     */
+    GdsfState_t* state = statePtr;
+    size_t frontier[2 * GDSF_MAX_PROBES + 1]; // positions in `state->heap`; each probe adds at most 2 and removes 1
+    size_t frontierLen = 0;
+
+    if (state->len) {
+        frontier[frontierLen++] = 0;
+    }
+    for (size_t probes = 0; frontierLen && probes < GDSF_MAX_PROBES; probes++) {
+        // pop the file with the lowest priority in the frontier
+        const size_t idx = frontier[0];
+        frontier[0] = frontier[--frontierLen];
+        for (size_t i = 0; 2 * i + 1 < frontierLen;) {
+            size_t child = 2 * i + 1;
+            if (child + 1 < frontierLen && gdsfPrecedes(state->heap[frontier[child + 1]], state->heap[frontier[child]])) {
+                child += 1;
+            }
+            if (!gdsfPrecedes(state->heap[frontier[child]], state->heap[frontier[i]])) {
+                break;
+            }
+            const size_t tmp = frontier[i];
+            frontier[i] = frontier[child];
+            frontier[child] = tmp;
+            i = child;
+        }
+
+        if (isEvictable(state->heap[idx], arg)) {
+            return state->heap[idx];
+        }
+        // its children might be evictable
+        for (size_t child = 2 * idx + 1; child <= 2 * idx + 2 && child < state->len; child++) {
+            size_t i = frontierLen++;
+            frontier[i] = child;
+            while (i > 0 && gdsfPrecedes(state->heap[frontier[i]], state->heap[frontier[(i - 1) / 2]])) {
+                const size_t tmp = frontier[i];
+                frontier[i] = frontier[(i - 1) / 2];
+                frontier[(i - 1) / 2] = tmp;
+                i = (i - 1) / 2;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+static const EvictionPolicy_t fifoPolicy = {
+    .name = "FIFO",
+    .allocShared = NULL,
+    .destroyShared = NULL,
+    .allocState = listAllocState,
+    .destroyState = listDestroyState,
+    .onInsert = listOnInsert,
+    .onAccess = NULL,
+    .onRemove = listOnRemove,
+    .onResize = NULL,
+    .pickVictim = listPickVictim,
+    .cmp = fifo_cmp,
+};
+
+static const EvictionPolicy_t lruPolicy = {
+    .name = "LRU",
+    .allocShared = NULL,
+    .destroyShared = NULL,
+    .allocState = listAllocState,
+    .destroyState = listDestroyState,
+    .onInsert = listOnInsert,
+    .onAccess = lruOnAccess,
+    .onRemove = listOnRemove,
+    .onResize = NULL,
+    .pickVictim = listPickVictim,
+    .cmp = lru_cmp,
+};
+
+static const EvictionPolicy_t lfuPolicy = {
+    .name = "LFU",
+    .allocShared = NULL,
+    .destroyShared = NULL,
+    .allocState = lfuAllocState,
+    .destroyState = lfuDestroyState,
+    .onInsert = lfuOnInsert,
+    .onAccess = lfuOnAccess,
+    .onRemove = lfuOnRemove,
+    .onResize = NULL,
+    .pickVictim = lfuPickVictim,
+    .cmp = lfu_cmp,
+};
+
+static const EvictionPolicy_t arcPolicy = {
+    .name = "ARC",
+    .allocShared = NULL,
+    .destroyShared = NULL,
+    .allocState = arcAllocState,
+    .destroyState = arcDestroyState,
+    .onInsert = arcOnInsert,
+    .onAccess = arcOnAccess,
+    .onRemove = arcOnRemove,
+    .onResize = NULL,
+    .pickVictim = arcPickVictim,
+    .cmp = arc_cmp,
+};
+
+static const EvictionPolicy_t gdsfPolicy = {
+    .name = "GDSF",
+    .allocShared = gdsfAllocShared,
+    .destroyShared = gdsfDestroyShared,
+    .allocState = gdsfAllocState,
+    .destroyState = gdsfDestroyState,
+    .onInsert = gdsfOnInsert,
+    .onAccess = gdsfOnAccess,
+    .onRemove = gdsfOnRemove,
+    .onResize = gdsfOnResize,
+    .pickVictim = gdsfPickVictim,
+    .cmp = gdsf_cmp,
+};
+
+const EvictionPolicy_t* evictionPolicies[NUM_REPLACEMENT_ALGOS] = { &fifoPolicy, &lruPolicy, &lfuPolicy, &arcPolicy, &gdsfPolicy };
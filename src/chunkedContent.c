@@ -0,0 +1,355 @@
+/*! \file */
+/**
+ * Content of a file, stored as a sequence of independently compressed chunks of at most `CHUNK_SIZE` bytes.
+ * Each chunk can be compressed with a different codec.
+ *
+ * Contents are immutable, reference-counted versions: changing a file means building a new version and
+ * publishing it in place of the old one, which stays valid for as long as someone holds a reference to it.
+ * Versions share the data of the chunks they have in common, which is reference-counted as well.
+ *
+ * Appending to a file only means compressing the new bytes into new chunks, rather than decompressing and
+ * recompressing the whole file: the new version copies the chunk descriptors of the old one and adds the new
+ * chunks after them. Small appends leave small chunks behind: `compactContent` merges runs of adjacent chunks
+ * back into chunks of up to `CHUNK_SIZE` bytes.
+ *
+ * A NULL version is an empty content.
+ *
+ * Chunks whose bytes look random (compressed media, encrypted data...) are stored raw, with `CODEC_NONE`:
+ * a few KB of each chunk are sampled, and the chunk isn't even handed to the codec if the entropy of their
+ * bytes is close to the maximum of 8 bits per byte. Raw chunks are read with plain copies, or not copied at all
+ * when a single one covers the whole range being read: readers are then handed a reference to its data.
+ */
+
+#include "../include/chunkedContent.h"
+#include "../include/codec.h"
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define ENTROPY_SAMPLE_BLOCKS 8 /**< Number of evenly spaced blocks of a chunk whose bytes are sampled */
+#define ENTROPY_BLOCK_SIZE 512
+#define RAW_ENTROPY_THRESHOLD 7.8 /**< Chunks whose sampled bytes have at least this many bits of entropy per byte are stored raw */
+
+static double sampleEntropy(const char* data, size_t size) {
+    // Shannon entropy, in bits per byte, of the byte histogram of a sample of the data
+    size_t histogram[256] = { 0 }, sampled = 0;
+    if (size <= ENTROPY_SAMPLE_BLOCKS * ENTROPY_BLOCK_SIZE) {
+        for (; sampled < size; sampled++) {
+            histogram[(unsigned char)data[sampled]]++;
+        }
+    }
+    else {
+        const size_t stride = (size - ENTROPY_BLOCK_SIZE) / (ENTROPY_SAMPLE_BLOCKS - 1);
+        for (size_t b = 0; b < ENTROPY_SAMPLE_BLOCKS; b++) {
+            const unsigned char* block = (const unsigned char*)data + b * stride;
+            for (size_t i = 0; i < ENTROPY_BLOCK_SIZE; i++) {
+                histogram[block[i]]++;
+            }
+        }
+        sampled = ENTROPY_SAMPLE_BLOCKS * ENTROPY_BLOCK_SIZE;
+    }
+    double entropy = 0;
+    for (size_t i = 0; i < 256; i++) {
+        if (histogram[i]) {
+            const double p = (double)histogram[i] / sampled;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy;
+}
+
+static bool compressChunk(ContentChunk_t* chunk, const char* data, unsigned char codec, char* scratch) {
+    /**
+     * @brief Compresses `chunk->uncompressedSize` bytes of data into the chunk, or stores them raw if they \n
+     * look incompressible or the codec would make them larger.
+     *
+     * @param scratch Buffer of at least `maxCompressedSize(CHUNK_SIZE)` bytes for `codec`
+     * @return `false` if memory for the chunk's data couldn't be allocated, `true` otherwise
+     */
+    const size_t size = chunk->uncompressedSize;
+    const char* src = data;
+    chunk->codec = CODEC_NONE;
+    chunk->compressedSize = size;
+    if (codec != CODEC_NONE && sampleEntropy(data, size) < RAW_ENTROPY_THRESHOLD) {
+        // compress into `scratch`, which is large enough for the worst case, then keep only as many bytes as needed
+        const size_t compressedSize = codecs[codec]->compress(data, size, scratch);
+        if (compressedSize < size) {
+            chunk->codec = codec;
+            chunk->compressedSize = compressedSize;
+            src = scratch;
+        }
+    }
+    if (!(chunk->data = allocSharedBuffer(chunk->compressedSize))) {
+        return false;
+    }
+    memcpy(chunk->data->data, src, chunk->compressedSize);
+    return true;
+}
+
+static size_t decompressChunk(const ContentChunk_t* chunk, char* dest, size_t limit) {
+    return codecs[chunk->codec]->decompress(chunk->data->data, chunk->compressedSize, dest, limit);
+}
+
+static void decompressChunksTo(const ContentChunk_t* chunks, size_t numChunks, char* dest) {
+    for (size_t i = 0; i < numChunks; i++) {
+        dest += decompressChunk(&(chunks[i]), dest, chunks[i].uncompressedSize);
+    }
+}
+
+static FileContent_t* allocContent(size_t maxChunks) {
+    // allocates a version with room for `maxChunks` chunks, holding a single reference owned by the caller
+    FileContent_t* content = malloc(sizeof(*content) + maxChunks * sizeof(ContentChunk_t));
+    if (!content) {
+        return NULL;
+    }
+    content->refs = 1;
+    content->uncompressedSize = content->compressedSize = content->numSmallChunks = content->numChunks = 0;
+    return content;
+}
+
+static void addChunk(FileContent_t* content, const ContentChunk_t* chunk) {
+    // adds a chunk whose data is already referenced on behalf of `content` after its last one
+    content->chunks[content->numChunks++] = *chunk;
+    content->uncompressedSize += chunk->uncompressedSize;
+    content->compressedSize += chunk->compressedSize;
+    content->numSmallChunks += (chunk->uncompressedSize < SMALL_CHUNK_SIZE);
+}
+
+void acquireContent(FileContent_t* content) {
+    /**
+     * @brief Takes a new reference to a version of a content. The caller must already hold one. \n
+     * Does nothing if `content` is NULL.
+     */
+    if (content) {
+        __atomic_add_fetch(&(content->refs), 1, __ATOMIC_RELAXED);
+    }
+}
+
+void releaseContent(FileContent_t* content) {
+    /**
+     * @brief Drops a reference to a version of a content, freeing it, along with the data of the chunks no other \n
+     * version shares, if it was the last one. Does nothing if `content` is NULL.
+     */
+    if (content && __atomic_sub_fetch(&(content->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+        for (size_t i = 0; i < content->numChunks; i++) {
+            releaseSharedBuffer(content->chunks[i].data);
+        }
+        free(content);
+    }
+}
+
+size_t contentOverhead(const FileContent_t* content) {
+    /**
+     * @brief Returns the number of bytes of memory used by a version of a content besides its compressed data \n
+     * (0 if `content` is NULL). Chunks shared with other versions are counted as if they weren't.
+     */
+    if (!content) {
+        return 0;
+    }
+    return sizeof(*content) + content->numChunks * (sizeof(ContentChunk_t) + sizeof(SharedBuffer_t));
+}
+
+FileContent_t* appendToContent(const FileContent_t* content, const char* data, size_t size, unsigned char codec) {
+    /**
+     * @brief Returns a new version of a content, with `size` bytes of data appended to it. The data is split into \n
+     * chunks of `CHUNK_SIZE` bytes (the last one might be smaller), compressed with the given codec unless \n
+     * they're incompressible; the chunks of `content` are shared with the new version, not copied.
+     *
+     * @param content The version to append to, which isn't modified (NULL if the content is empty)
+     * @param size Must be greater than 0
+     * @return The new version, holding a single reference owned by the caller, or NULL on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `ENOMEM` memory for the new version couldn't be allocated
+     */
+    const size_t numOldChunks = content ? content->numChunks : 0;
+    const size_t count = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    FileContent_t* ret = allocContent(numOldChunks + count);
+    char* scratch = malloc(codecs[codec]->maxCompressedSize(CHUNK_SIZE));
+    if (!ret || !scratch) {
+        free(ret);
+        free(scratch);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < numOldChunks; i++) {
+        acquireSharedBuffer(content->chunks[i].data);
+        addChunk(ret, &(content->chunks[i]));
+    }
+    for (size_t i = 0; i < count; i++) {
+        ContentChunk_t chunk;
+        chunk.uncompressedSize = (i == count - 1) ? size - i * CHUNK_SIZE : CHUNK_SIZE;
+        chunk.offset = ret->uncompressedSize;
+        if (!compressChunk(&chunk, data + i * CHUNK_SIZE, codec, scratch)) {
+            free(scratch);
+            releaseContent(ret);
+            errno = ENOMEM;
+            return NULL;
+        }
+        addChunk(ret, &chunk);
+    }
+    free(scratch);
+    return ret;
+}
+
+void decompressContentTo(const FileContent_t* content, char* dest) {
+    /**
+     * @brief Decompresses the content into `dest`, which must be large enough to hold all of its bytes.
+     */
+    if (content) {
+        decompressChunksTo(content->chunks, content->numChunks, dest);
+    }
+}
+
+static size_t findChunk(const ContentChunk_t* chunks, size_t numChunks, size_t offset) {
+    // binary search for the last chunk starting at or before `offset`
+    size_t lo = 0, hi = numChunks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (chunks[mid].offset <= offset) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+SharedBuffer_t* shareRawRange(const FileContent_t* content, size_t offset, size_t len, const char** data) {
+    /**
+     * @brief Returns a new reference to the data of the raw chunk holding the `len` bytes of content starting \n
+     * at `offset`, so that they can be read without copying them, and points `*data` to the first of them.
+     * @note The range must lie within the content.
+     *
+     * @return The chunk's data, which the caller needs to release with `releaseSharedBuffer`, or NULL if the \n
+     * range is empty or isn't entirely within a single raw chunk
+     */
+    if (!len) {
+        return NULL;
+    }
+    const ContentChunk_t* chunk = &(content->chunks[findChunk(content->chunks, content->numChunks, offset)]);
+    if (chunk->codec != CODEC_NONE || offset + len > chunk->offset + chunk->uncompressedSize) {
+        return NULL;
+    }
+    acquireSharedBuffer(chunk->data);
+    *data = chunk->data->data + (offset - chunk->offset);
+    return chunk->data;
+}
+
+int decompressContentRange(const FileContent_t* content, size_t offset, size_t len, char* dest) {
+    /**
+     * @brief Decompresses `len` bytes of content, starting at `offset`, into `dest`. Only the chunks covering \n
+     * the range are decompressed.
+     * @note The range must lie within the content.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `ENOMEM` memory to decompress a chunk that's only partially covered by the range couldn't be allocated
+     */
+    if (!len) {
+        return 0;
+    }
+    const ContentChunk_t* chunks = content->chunks;
+    char* partial = NULL; // chunks only partially covered by the range are decompressed here first
+    for (size_t i = findChunk(chunks, content->numChunks, offset); len && i < content->numChunks; i++) {
+        const size_t skip = offset - chunks[i].offset;
+        const size_t take = MIN(len, chunks[i].uncompressedSize - skip);
+        if (chunks[i].codec == CODEC_NONE) {
+            // raw chunks can be copied from straight away, even partially
+            memcpy(dest, chunks[i].data->data + skip, take);
+        }
+        else if (take == chunks[i].uncompressedSize) {
+            decompressChunk(&(chunks[i]), dest, take);
+        }
+        else {
+            if (!partial && !(partial = malloc(CHUNK_SIZE))) {
+                errno = ENOMEM;
+                return -1;
+            }
+            // the rest of the chunk isn't needed
+            decompressChunk(&(chunks[i]), partial, skip + take);
+            memcpy(dest, partial + skip, take);
+        }
+        dest += take;
+        offset += take;
+        len -= take;
+    }
+    free(partial);
+    return 0;
+}
+
+char* decompressContent(const FileContent_t* content, size_t extraAllocation) {
+    /**
+     * @brief Returns a buffer holding the decompressed content, followed by `extraAllocation` zeroed bytes.
+     *
+     * @return The buffer, which needs to be `free`d by the caller, or NULL on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `ENOMEM` memory for the buffer couldn't be allocated
+     */
+    char* ret = calloc((content ? content->uncompressedSize : 0) + extraAllocation, 1);
+    if (!ret) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    decompressContentTo(content, ret);
+    return ret;
+}
+
+FileContent_t* compactContent(const FileContent_t* content, unsigned char codec) {
+    /**
+     * @brief Returns a new version of a content in which every run of adjacent chunks that fits in `CHUNK_SIZE` \n
+     * bytes has been merged into a single chunk, compressed with the given codec. The chunks that aren't merged \n
+     * with any other are shared with `content`, which isn't modified.
+     *
+     * @return The new version, holding a single reference owned by the caller, or NULL on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `ENOMEM` memory for the new version couldn't be allocated
+     */
+    const size_t numChunks = content ? content->numChunks : 0;
+    const ContentChunk_t* chunks = content ? content->chunks : NULL;
+    FileContent_t* merged = allocContent(numChunks);
+    char* scratch = malloc(codecs[codec]->maxCompressedSize(CHUNK_SIZE));
+    char* buf = malloc(CHUNK_SIZE);
+    if (!merged || !scratch || !buf) {
+        free(merged);
+        free(scratch);
+        free(buf);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < numChunks;) {
+        // extend the run as long as it fits in a chunk
+        size_t runEnd = i + 1, runSize = chunks[i].uncompressedSize;
+        while (runEnd < numChunks && runSize + chunks[runEnd].uncompressedSize <= CHUNK_SIZE) {
+            runSize += chunks[runEnd++].uncompressedSize;
+        }
+        if (runEnd == i + 1) {
+            acquireSharedBuffer(chunks[i].data);
+            addChunk(merged, &(chunks[i]));
+        }
+        else {
+            ContentChunk_t chunk;
+            chunk.uncompressedSize = runSize;
+            chunk.offset = chunks[i].offset;
+            decompressChunksTo(chunks + i, runEnd - i, buf);
+            if (!compressChunk(&chunk, buf, codec, scratch)) {
+                free(buf);
+                free(scratch);
+                releaseContent(merged);
+                errno = ENOMEM;
+                return NULL;
+            }
+            addChunk(merged, &chunk);
+        }
+        i = runEnd;
+    }
+    free(buf);
+    free(scratch);
+    return merged;
+}
@@ -29,15 +29,16 @@ char* realpath(const char* restrict path,
 #define USAGE_MSG "-h (help)\n-f filename (set socket name)\n-w dirname [,n=0] (send files in `dirname`,"\
 " up to `n`, or all files in the directory)\n-W file1 [,file2] (send file1, ..., fileN)\n-D dirname (set `dirname`"\
 " as target for files sent from server in response to -w/-W)\n-r file1 [,file2] (send read request for file1,"\
-" ..., fileN)\n-R [n=0] (send read request for `n` files, or all files on the server)\n-d dirname (set `dirname` as target"\
-" for files sent from server in response to -r/-R)\n-t time (set time interval in between requests)\n-l file1 [,file2] ("\
+" ..., fileN)\n-R [n=0] (send read request for `n` files, or all files on the server)\n-g file,offset,len (send read"\
+" request for `len` bytes of `file`, starting at `offset`)\n-d dirname (set `dirname` as target"\
+" for files sent from server in response to -r/-R/-g)\n-t time (set time interval in between requests)\n-l file1 [,file2] ("\
 "send lock request for file1, ..., fileN)\n-u file1 [,file2] (send unlock request for file1, ..., fileN)\n-c file1 [,file2] "\
 "(send delete request for file1, ..., fileN)\n-p (enable prints for info and errors)\n"
 
 #define TOO_MANY_P_MSG "You can only enable prints once.\n"
 #define TOO_MANY_T_MSG "You can only set -t once.\n"
 #define TOO_MANY_F_MSG "You can only set the socket name once.\n"
-#define d_AFTER_R_MSG "You can only use the -d option after -r or -R\n"
+#define d_AFTER_R_MSG "You can only use the -d option after -r, -R or -g\n"
 #define D_AFTER_W_MSG "You can only use the -D option after -w or -W\n"
 #define ARG_REQUIRED_MSG "Option %c requires an argument.\n"
 #define NO_CMD_MSG "No commands were given.\n"
@@ -161,6 +162,56 @@ int smallrHandler(char* arg, char* dirname) {
     return 0;
 }
 
+int smallgHandler(char* arg, char* dirname) {
+    long offset = 0, len = 0;
+    char* strtok_r_savePtr;
+    char* file = strtok_r(arg, ",", &strtok_r_savePtr);
+
+    char* _offset = strtok_r(NULL, ",", &strtok_r_savePtr);
+    char* _len = strtok_r(NULL, ",", &strtok_r_savePtr);
+    if (!_offset || !_len || isNumber(_offset, &offset) != 0 || isNumber(_len, &len) != 0 || offset < 0 || len < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    char* outBuf = NULL;
+    size_t rangeSize = 0;
+    if (openFile(file, O_NOFLAG) == -1) {
+        return (errno == EBADE) ? 0 : -1;
+    }
+    if (readFileRange(file, offset, len, (void**)&outBuf, &rangeSize) == -1) {
+        // `EBADE` means the request failed on the server-side, so there's nothing to save
+        return (errno == EBADE) ? 0 : -1;
+    }
+    if (dirname) {
+        // build `dirname/pathOfFile`
+        char* filepathBuf = calloc(strlen(dirname) + strlen(file) + 2, 1);
+        if (!filepathBuf) {
+            free(outBuf);
+            return -1;
+        }
+        strcpy(filepathBuf, dirname);
+        strcat(filepathBuf, "/");
+        strcat(filepathBuf, file);
+
+        if (saveFileToDisk(filepathBuf, outBuf, rangeSize) == -1) {
+            perror("saveFileToDisk");
+            free(filepathBuf);
+            free(outBuf);
+            return -1;
+        }
+        free(filepathBuf);
+    }
+    else if (PRINTS_ENABLED) {
+        fprintf(stdout, "Read files were thrown away. To store them, use -d.\n");
+    }
+    free(outBuf);
+    if (closeFile(file) == -1 && errno != EBADE) {
+        perror("closeFile");
+        return -1;
+    }
+    return 0;
+}
+
 int visitDirAndWrite(char* fromDir, char* dirname, size_t upTo) {
     DIR* targetDir = NULL;
     struct dirent* currFile;
@@ -319,6 +370,19 @@ int runCommands(CliOption* cliCommandList, long tBetweenReqs, bool validateOnly)
                 readNFiles(nArg, dirname);
             }
             break;
+        case 'g':
+            FAIL_IF_NO_ARG(cliCommandList, 'g');
+            if (cliCommandList->nextPtr && cliCommandList->nextPtr->option == 'd') {
+                FAIL_IF_NO_ARG(cliCommandList->nextPtr, 'd');
+                dirname = cliCommandList->nextPtr->argument;
+                skipNext = true;
+            }
+            if (!validateOnly) {
+                if (smallgHandler(cliCommandList->argument, dirname) == -1) {
+                    return -1;
+                }
+            }
+            break;
         case 'l':
             FAIL_IF_NO_ARG(cliCommandList, 'l');
             if (!validateOnly) {
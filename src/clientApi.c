@@ -33,6 +33,7 @@ const char* errMessages[] = {
     "An error on the server-side occurred.\n",
     "Invalid request code or payload.\n",
     "File already exists.\n",
+    "File not stored: the storage is full of files that are used more often.\n",
 };
 
 #define INITIAL_REQ_SIZ 1024
@@ -129,6 +130,49 @@ static int storeFiles(const char* dirname) {
     return count;
 }
 
+static int receiveReadContent(const char* pathname, void** buf, size_t* size) {
+    /**
+     * @brief Receives the response to a read request: the response code, then the read content.
+     *
+     * @param buf Output parameter: buffer allocated on the heap which contains the read content
+     * @param size Output parameter: amount of bytes read
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    char
+        recvLine1[RES_CODE_LEN + 1] = "", // for response code
+        recvLine2[METADATA_SIZE + 1] = "", // to get the size of the payload
+        * recvLine3; // for the rest of the response
+
+    WAIT_FOR_RESPONSE(recvLine1, Read, pathname);
+
+    // read size of file content
+    if (readn(SOCKET_FD, recvLine2, METADATA_SIZE) == -1) {
+        return -1;
+    }
+    long responseSize;
+    if (isNumber(recvLine2, &responseSize) != 0) {
+        PRINT_IF_ENABLED(stderr, Read, pathname, "Invalid response from server.\n");
+        errno = EINVAL;
+        return -1;
+    }
+    // allocate space for the file content
+    recvLine3 = calloc(responseSize + 1, 1);
+    if (!recvLine3) {
+        return -1;
+    }
+    if (readn(SOCKET_FD, recvLine3, responseSize) == -1) { // read the actual content of the file
+        free(recvLine3);
+        return -1;
+    }
+    PRINT_PROCESSED_SIZE_IF_ENABLED(responseSize, read);
+
+    *size = responseSize;
+    *buf = recvLine3;
+
+    return 0;
+}
+
 int openConnection(const char* sockname, int msec, const struct timespec abstime) {
     struct sockaddr_un sockaddr;
     strncpy(sockaddr.sun_path, sockname, UNIX_PATH_MAX);
@@ -249,37 +293,31 @@ int readFile(const char* pathname, void** buf, size_t* size) {
     }
     free(req);
 
-    char
-        recvLine1[RES_CODE_LEN + 1] = "", // for response code
-        recvLine2[METADATA_SIZE + 1] = "", // to get the size of the payload
-        * recvLine3; // for the rest of the response
-
-    WAIT_FOR_RESPONSE(recvLine1, Read, pathname);
+    return receiveReadContent(pathname, buf, size);
+}
 
-    // read size of file content
-    if (readn(SOCKET_FD, recvLine2, METADATA_SIZE) == -1) {
-        return -1;
-    }
-    long responseSize;
-    if (isNumber(recvLine2, &responseSize) != 0) {
-        PRINT_IF_ENABLED(stderr, Read, pathname, "Invalid response from server.\n");
+int readFileRange(const char* pathname, size_t offset, size_t len, void** buf, size_t* size) {
+    if (!pathname || !strlen(pathname) || !buf || !size) {
         errno = EINVAL;
         return -1;
     }
-    // allocate space for the file content
-    recvLine3 = calloc(responseSize + 1, 1);
-    if (!recvLine3) {
+    size_t pathnameLen = strlen(pathname);
+    size_t reqLen = REQ_CODE_LEN + METADATA_SIZE + pathnameLen + METADATA_SIZE + METADATA_SIZE + 1;
+    char* req = calloc(reqLen, 1);
+    if (!req) {
+        errno = ENOMEM;
         return -1;
     }
-    if (readn(SOCKET_FD, recvLine3, responseSize) == -1) { // read the actual content of the file
+
+    // construct request message
+    snprintf(req, reqLen + 1, "%d%010ld%s%010ld%010ld", READ_RANGE, pathnameLen, pathname, offset, len);
+
+    if (writen(SOCKET_FD, req, reqLen - 1) == -1) {
         return -1;
     }
-    PRINT_PROCESSED_SIZE_IF_ENABLED(responseSize, read);
-
-    *size = responseSize;
-    *buf = recvLine3;
+    free(req);
 
-    return 0;
+    return receiveReadContent(pathname, buf, size);
 }
 
 int writeFile(const char* pathname, const char* dirname) {
@@ -0,0 +1,81 @@
+/*! \file */
+/**
+ * Registry of the compression codecs content can be stored with, indexed by the `CODEC_*` constants.
+ *
+ * Every chunk of content records the id of the codec it was compressed with, so that the default codec can be
+ * changed without making content stored with the previous one unreadable.
+ */
+
+#include "../include/codec.h"
+#include "../include/rleCompression.h"
+#include "../include/lzCompression.h"
+#include <string.h>
+
+static size_t noneMaxCompressedSize(size_t size) {
+    return size;
+}
+
+static size_t noneCompress(const char* src, size_t size, char* dest) {
+    memcpy(dest, src, size);
+    return size;
+}
+
+static size_t noneDecompress(const char* src, size_t compressedSize, char* dest, size_t uncompressedSize) {
+    const size_t size = (compressedSize < uncompressedSize) ? compressedSize : uncompressedSize;
+    memcpy(dest, src, size);
+    return size;
+}
+
+static size_t rleMaxCompressedSize(size_t size) {
+    return 2 * size;
+}
+
+static size_t rleCompress(const char* src, size_t size, char* dest) {
+    return RLEcompressTo((char*)src, size, dest);
+}
+
+static size_t rleDecompress(const char* src, size_t compressedSize, char* dest, size_t uncompressedSize) {
+    return RLEdecompressTo((char*)src, compressedSize, uncompressedSize, dest);
+}
+
+static size_t rle2MaxCompressedSize(size_t size) {
+    return RLE2_MAX_COMPRESSED_SIZE(size);
+}
+
+static size_t rle2Decompress(const char* src, size_t compressedSize, char* dest, size_t uncompressedSize) {
+    return RLE2decompressTo(src, compressedSize, uncompressedSize, dest);
+}
+
+static size_t lzMaxCompressedSize(size_t size) {
+    return LZ_MAX_COMPRESSED_SIZE(size);
+}
+
+static const CompressionCodec_t noneCodec = {
+    .name = "none",
+    .maxCompressedSize = noneMaxCompressedSize,
+    .compress = noneCompress,
+    .decompress = noneDecompress,
+};
+
+static const CompressionCodec_t rleCodec = {
+    .name = "RLE",
+    .maxCompressedSize = rleMaxCompressedSize,
+    .compress = rleCompress,
+    .decompress = rleDecompress,
+};
+
+static const CompressionCodec_t rle2Codec = {
+    .name = "RLEv2",
+    .maxCompressedSize = rle2MaxCompressedSize,
+    .compress = RLE2compressTo,
+    .decompress = rle2Decompress,
+};
+
+static const CompressionCodec_t lzCodec = {
+    .name = "LZ",
+    .maxCompressedSize = lzMaxCompressedSize,
+    .compress = LZcompress,
+    .decompress = LZdecompress,
+};
+
+const CompressionCodec_t* codecs[NUM_CODECS] = { &noneCodec, &rleCodec, &lzCodec, &rle2Codec };
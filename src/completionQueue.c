@@ -0,0 +1,213 @@
+/*! \file */
+/**
+ * Bounded multi-producer single-consumer queue used by workers to hand client fd's back to the manager.
+ *
+ * Workers push binary completion records into a ring of sequenced cells; the manager sleeps in `epoll_wait`
+ * on an eventfd that is only written when the queue goes from empty to non-empty, so under load a whole
+ * batch of completions costs a single eventfd write/read pair.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "../include/completionQueue.h"
+#include "../utils/scerrhand.h"
+#include <sys/eventfd.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define CACHE_LINE_SIZE 64
+
+struct _cell {
+    /**
+     * @brief A slot of the ring.
+     *
+     * `sequence` equals the slot's index when the slot is free for the producer that claims that position,
+     * and the index + 1 once the record has been published and can be consumed.
+     */
+    size_t sequence;
+    struct completion data;
+};
+
+struct _completionQueue {
+    /**
+     * @brief A lock-free ring of completion records with an eventfd for wakeups.
+     */
+    struct _cell* cells;
+    size_t mask; /**< Capacity of the ring minus one (capacity is a power of two) */
+    int eventFd; /**< Readable whenever the consumer needs to drain the queue */
+
+    // producer and consumer positions live on separate cache lines to avoid false sharing
+    char pad0[CACHE_LINE_SIZE];
+    size_t enqueuePos; /**< Next position to be claimed by a producer */
+    char pad1[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t pending; /**< Number of published records that haven't been consumed yet */
+    char pad2[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t dequeuePos; /**< Next position to be consumed; only ever touched by the consumer */
+    char pad3[CACHE_LINE_SIZE - sizeof(size_t)];
+};
+
+CompletionQueue* allocCompletionQueue(size_t capacity) {
+    /**
+     * @brief Initializes and returns a new empty completion queue.
+     * @param capacity Minimum number of records the queue can hold at once (rounded up to a power of two)
+     * @return A pointer to the newly created queue upon success, NULL on error (sets `errno`)
+     *
+     * Upon error, `errno` will have one of the following values:\n
+     * `ENOMEM`: memory for the queue couldn't be allocated\n
+     * `EINVAL`: invalid parameter(s) were passed\n
+     * any of the values set by `eventfd`
+     */
+    if (capacity < 2) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t actualCapacity = 2;
+    while (actualCapacity < capacity) {
+        actualCapacity <<= 1;
+    }
+
+    CompletionQueue* queue = calloc(1, sizeof(*queue));
+    if (!queue) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    queue->cells = malloc(actualCapacity * sizeof(struct _cell));
+    if (!queue->cells) {
+        free(queue);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((queue->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        int errnosave = errno;
+        free(queue->cells);
+        free(queue);
+        errno = errnosave;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < actualCapacity; i++) {
+        queue->cells[i].sequence = i;
+    }
+    queue->mask = actualCapacity - 1;
+
+    return queue;
+}
+
+int destroyCompletionQueue(CompletionQueue* queue) {
+    /**
+     * @brief Closes the queue's eventfd and frees the queue.
+     * @note Assumes no other thread is using the queue anymore.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    if (!queue) {
+        errno = EINVAL;
+        return -1;
+    }
+    close(queue->eventFd);
+    free(queue->cells);
+    free(queue);
+    return 0;
+}
+
+int getCompletionQueueFd(const CompletionQueue* queue) {
+    /**
+     * @brief Returns the fd the consumer should wait on (for reading) to know when to drain the queue.
+     */
+    return queue->eventFd;
+}
+
+int pushCompletion(CompletionQueue* queue, int fd, int type) {
+    /**
+     * @brief Publishes a completion record. Can be called concurrently by any number of producers.
+     * If the ring is full, yields until the consumer frees a slot.
+     *
+     * @param fd The client fd the record refers to
+     * @param type One of the `COMPLETION_*` codes
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    if (!queue || fd <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct _cell* cell;
+    size_t pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+    while (true) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            // slot is free: try to claim it
+            if (__atomic_compare_exchange_n(&queue->enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // ring is full: let the manager catch up
+            sched_yield();
+            pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+        }
+        else {
+            // another producer claimed this position first
+            pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data.fd = fd;
+    cell->data.type = type;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    // only the producer that makes the queue non-empty needs to wake up the consumer
+    if (__atomic_fetch_add(&queue->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        uint64_t one = 1;
+        DIE_ON_NEG_ONE(write(queue->eventFd, &one, sizeof(one)));
+    }
+    return 0;
+}
+
+int beginDrain(CompletionQueue* queue) {
+    /**
+     * @brief Resets the queue's eventfd. Must be called by the consumer every time the eventfd is reported
+     * readable, before popping the pending records with `popCompletion`.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    uint64_t count;
+    if (read(queue->eventFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        return -1;
+    }
+    return 0;
+}
+
+bool popCompletion(CompletionQueue* queue, struct completion* dest) {
+    /**
+     * @brief Pops the oldest pending record. Must only be called by the (single) consumer.
+     *
+     * @param dest A pointer to a location to save the popped record to
+     *
+     * @return `true` if a record was popped, `false` if there are no more pending records
+     */
+    if (__atomic_load_n(&queue->pending, __ATOMIC_ACQUIRE) == 0) {
+        return false;
+    }
+
+    struct _cell* cell = &queue->cells[queue->dequeuePos & queue->mask];
+    // at least one record has been published; the one at the head of the ring might still be
+    // in the middle of being written by a producer that claimed its slot first, though
+    while (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != queue->dequeuePos + 1) {
+        sched_yield();
+    }
+
+    *dest = cell->data;
+    __atomic_store_n(&cell->sequence, queue->dequeuePos + queue->mask + 1, __ATOMIC_RELEASE);
+    queue->dequeuePos += 1;
+
+    __atomic_fetch_sub(&queue->pending, 1, __ATOMIC_ACQ_REL);
+    return true;
+}
@@ -0,0 +1,225 @@
+/*! \file */
+/**
+ * Epoch-based reclamation: lets threads read shared objects without locking them, while other threads
+ * unlink and retire those objects, which are then freed once no reader can still be looking at them.
+ *
+ * Readers wrap every lock-free access between `epochEnter` and `epochExit`. The domain has a global epoch
+ * counter, and each thread that enters it records the epoch it observed. An object that has been unlinked
+ * (so that new readers can't find it anymore) is retired during the current global epoch `e`: readers that
+ * might still hold a pointer to it entered during `e` at the latest. The global epoch only moves forward
+ * once every thread that's inside the domain has observed its current value, so by the time it reaches
+ * `e + 2` all of those readers have exited, and the object can be freed.
+ *
+ * Each thread keeps its retired objects in three lists, one per epoch modulo 3, and tries to advance the global
+ * epoch and free its lists that are old enough every `EPOCH_RECLAIM_INTERVAL` retirements, whenever it exits the
+ * domain with objects left to free, and when it calls `epochReclaim`. Objects retired by threads that stop doing
+ * any of that are freed when the domain is destroyed.
+ */
+
+#include "../include/epoch.h"
+#include "../utils/scerrhand.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define EPOCH_LISTS 3
+#define EPOCH_RECLAIM_INTERVAL 32 /**< A thread tries to advance the global epoch every this many retirements */
+
+struct _retired {
+    void* ptr;
+    void (*freeFn)(void*);
+    struct _retired* next;
+};
+
+struct _epochRecord {
+    size_t epoch; /**< Only accessed atomically; global epoch observed when the thread last entered the domain */
+    bool active; /**< Only accessed atomically; whether the thread is inside the domain */
+    unsigned depth; /**< Number of nested `epochEnter` calls; only used by the owner thread */
+    struct _retired* limbo[EPOCH_LISTS]; /**< Objects retired by the owner thread, by epoch modulo `EPOCH_LISTS` */
+    size_t limboEpoch[EPOCH_LISTS]; /**< Epoch during which the objects of each list were retired */
+    size_t sinceReclaim; /**< Retirements since the owner thread last tried to advance the epoch */
+    struct _epochRecord* next; /**< Records are never removed from the list, so this never changes once set */
+};
+
+struct _epochDomain {
+    size_t globalEpoch; /**< Only accessed atomically */
+    pthread_key_t key; /**< Record of the calling thread */
+    struct _epochRecord* records; /**< Only accessed atomically; records of all the threads that ever entered the domain */
+};
+
+static void _freeList(struct _retired* list) {
+    while (list) {
+        struct _retired* tmp = list;
+        list = list->next;
+        tmp->freeFn(tmp->ptr);
+        free(tmp);
+    }
+}
+
+static struct _epochRecord* _getRecord(EpochDomain* domain) {
+    struct _epochRecord* rec = pthread_getspecific(domain->key);
+    if (!rec) {
+        // first time the thread uses the domain: publish a record for it
+        DIE_ON_NULL((rec = calloc(1, sizeof(*rec))));
+        DIE_ON_NZ(pthread_setspecific(domain->key, rec));
+        rec->next = __atomic_load_n(&(domain->records), __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&(domain->records), &(rec->next), rec, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    return rec;
+}
+
+static bool _tryAdvance(EpochDomain* domain) {
+    /**
+     * @brief Moves the global epoch forward, unless a thread inside the domain hasn't observed its current value yet.
+     */
+    size_t epoch = __atomic_load_n(&(domain->globalEpoch), __ATOMIC_SEQ_CST);
+    for (struct _epochRecord* rec = __atomic_load_n(&(domain->records), __ATOMIC_ACQUIRE); rec; rec = rec->next) {
+        if (__atomic_load_n(&(rec->active), __ATOMIC_SEQ_CST) && __atomic_load_n(&(rec->epoch), __ATOMIC_SEQ_CST) != epoch) {
+            return false;
+        }
+    }
+    return __atomic_compare_exchange_n(&(domain->globalEpoch), &epoch, epoch + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static bool _hasLimbo(const struct _epochRecord* rec) {
+    for (size_t i = 0; i < EPOCH_LISTS; i++) {
+        if (rec->limbo[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _reclaim(EpochDomain* domain, struct _epochRecord* rec) {
+    /**
+     * @brief Tries to advance the global epoch, then frees the lists of `rec` that were retired at least 2 epochs ago.
+     */
+    rec->sinceReclaim = 0;
+    _tryAdvance(domain);
+    const size_t current = __atomic_load_n(&(domain->globalEpoch), __ATOMIC_SEQ_CST);
+    for (size_t j = 0; j < EPOCH_LISTS; j++) {
+        if (rec->limbo[j] && rec->limboEpoch[j] + 2 <= current) {
+            _freeList(rec->limbo[j]);
+            rec->limbo[j] = NULL;
+        }
+    }
+}
+
+
+EpochDomain* allocEpochDomain(void) {
+    /**
+     * @brief Allocates a new reclamation domain.
+     *
+     * @return The domain, or NULL on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `ENOMEM` memory for the domain couldn't be allocated \n
+     * `EAGAIN` the system is out of thread-specific data keys
+     */
+    EpochDomain* domain = calloc(1, sizeof(*domain));
+    if (!domain) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    int err = pthread_key_create(&(domain->key), NULL);
+    if (err) {
+        free(domain);
+        errno = err;
+        return NULL;
+    }
+    return domain;
+}
+
+int destroyEpochDomain(EpochDomain* domain) {
+    /**
+     * @brief Frees every object that's still waiting to be reclaimed, then the domain itself.
+     *
+     * @note Assumes no thread is inside the domain or will use it anymore.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    if (!domain) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct _epochRecord* rec = domain->records;
+    while (rec) {
+        struct _epochRecord* tmp = rec;
+        rec = rec->next;
+        for (size_t i = 0; i < EPOCH_LISTS; i++) {
+            _freeList(tmp->limbo[i]);
+        }
+        free(tmp);
+    }
+    DIE_ON_NZ(pthread_key_delete(domain->key));
+    free(domain);
+    return 0;
+}
+
+void epochEnter(EpochDomain* domain) {
+    /**
+     * @brief Marks the calling thread as reading objects of the domain: none of the objects retired from now on \n
+     * is freed until the thread calls `epochExit`. Calls can be nested.
+     */
+    struct _epochRecord* rec = _getRecord(domain);
+    if (rec->depth++ == 0) {
+        __atomic_store_n(&(rec->active), true, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&(rec->epoch), __atomic_load_n(&(domain->globalEpoch), __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    }
+}
+
+void epochExit(EpochDomain* domain) {
+    /**
+     * @brief Marks the calling thread as done reading the objects of the domain it has found since the matching `epochEnter`.
+     */
+    struct _epochRecord* rec = pthread_getspecific(domain->key);
+    if (--(rec->depth) == 0) {
+        __atomic_store_n(&(rec->active), false, __ATOMIC_RELEASE);
+        // don't let objects wait for the thread's next retirements, which might be far away
+        if (_hasLimbo(rec)) {
+            _reclaim(domain, rec);
+        }
+    }
+}
+
+void epochReclaim(EpochDomain* domain) {
+    /**
+     * @brief Frees the objects retired by the calling thread that no reader can be looking at anymore.
+     * @details Meant for threads that retire objects without ever entering the domain, before they go idle.
+     *
+     * @note The calling thread must not be inside the domain.
+     */
+    struct _epochRecord* rec = _getRecord(domain);
+    if (_hasLimbo(rec)) {
+        _reclaim(domain, rec);
+    }
+}
+
+void epochRetire(EpochDomain* domain, void* ptr, void (*freeFn)(void*)) {
+    /**
+     * @brief Calls `freeFn(ptr)` once no thread can be reading `ptr` anymore.
+     *
+     * @note The object must already be unreachable for threads that enter the domain from now on.
+     */
+    struct _epochRecord* rec = _getRecord(domain);
+    struct _retired* node;
+    DIE_ON_NULL((node = malloc(sizeof(*node))));
+    node->ptr = ptr;
+    node->freeFn = freeFn;
+
+    const size_t epoch = __atomic_load_n(&(domain->globalEpoch), __ATOMIC_SEQ_CST);
+    const size_t i = epoch % EPOCH_LISTS;
+    if (rec->limboEpoch[i] != epoch) {
+        // the list was filled at least `EPOCH_LISTS` epochs ago: its objects are safe to free
+        _freeList(rec->limbo[i]);
+        rec->limbo[i] = NULL;
+        rec->limboEpoch[i] = epoch;
+    }
+    node->next = rec->limbo[i];
+    rec->limbo[i] = node;
+
+    if (++(rec->sinceReclaim) >= EPOCH_RECLAIM_INTERVAL) {
+        _reclaim(domain, rec);
+    }
+}
@@ -0,0 +1,431 @@
+/*! \file */
+/**
+ * Open-addressing hash index mapping pathnames to files, modeled after SwissTable.
+ *
+ * Slots are grouped 16 at a time, and every slot has a control byte which is either `CTRL_EMPTY`,
+ * `CTRL_DELETED` or, for slots in use, the low 7 bits of the key's hash (its "tag"). A probe compares
+ * the tag against the 16 control bytes of a group at once (with SSE2 where available), and only looks at
+ * the slots whose tag matches; those also store the key's full 64-bit hash, so a pathname is only compared
+ * when the hashes are equal, which nearly always means it's the pathname being looked for.
+ *
+ * When the table fills up, a new one is allocated and entries are moved over a few groups at a time by the
+ * following insertions and removals, so no single operation has to rehash the whole index. While that
+ * happens, lookups search both tables.
+ *
+ * Modifications must be serialized by the caller, but lookups can run concurrently with them, from threads
+ * inside an epoch of the domain the index was created with. A slot is written before its control byte is
+ * published and never changes afterwards: removed entries become tombstones, and only empty slots are filled,
+ * so that a lookup can't read a slot while it's being overwritten. Tables are retired to the epoch domain
+ * rather than freed, and lookups that miss while a resize has started retry, as the key might have been on
+ * its way from one table to the other.
+ */
+
+#include "../include/fileIndex.h"
+#include "../include/epoch.h"
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define GROUP_WIDTH 16
+#define MIN_CAPACITY GROUP_WIDTH
+#define MIGRATE_GROUPS 2 /**< Number of groups moved to the new table by each insertion or removal during a resize */
+
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+#define IS_FULL(ctrl) ((ctrl) >= 0)
+
+#define H1(hash) ((hash) >> 7) /**< Selects the group probing starts from */
+#define H2(hash) ((int8_t)((hash) & 0x7F)) /**< Tag stored in the control byte */
+
+#define NOT_FOUND SIZE_MAX
+
+struct _slot {
+    uint64_t hash;
+    const char* key;
+    void* value;
+};
+
+struct _table {
+    int8_t* ctrl; /**< One control byte per slot, only written atomically, a word at a time (see `_setCtrl`) */
+    struct _slot* slots;
+    size_t groupMask; /**< Number of groups minus one (the number of groups is a power of two) */
+    size_t used; /**< Number of slots in use */
+    size_t growthLeft; /**< Number of empty slots that can be filled before the table has to be resized */
+};
+
+struct _fileIndex {
+    /**
+     * @brief A hash index that grows incrementally.
+     */
+    struct _table* curr; /**< Only written atomically; all insertions go here */
+    struct _table* old; /**< Only written atomically; table being emptied into `curr`, or NULL if no resize is in progress */
+    size_t migrateGroup; /**< Next group of `old` to be moved */
+    size_t resizes; /**< Only accessed atomically; number of resizes started so far */
+    EpochDomain* epochs; /**< Domain replaced tables are retired to; NULL if lookups never run concurrently with modifications */
+};
+
+
+uint64_t hashPathname(const char* pathname) {
+    /**
+     * @brief Computes a 64-bit hash of the given string, processing it 8 bytes at a time.
+     */
+    size_t len = strlen(pathname);
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ (len * 0xFF51AFD7ED558CCDULL);
+    uint64_t word;
+
+    for (; len >= sizeof(word); len -= sizeof(word), pathname += sizeof(word)) {
+        memcpy(&word, pathname, sizeof(word));
+        hash = (hash ^ word) * 0xC4CEB9FE1A85EC53ULL;
+        hash ^= hash >> 29;
+    }
+    word = 0;
+    memcpy(&word, pathname, len);
+    hash = (hash ^ word) * 0xC4CEB9FE1A85EC53ULL;
+
+    // final avalanche, so that both the low bits (tag) and the high bits are well mixed
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static inline uint32_t _matchByte(const int8_t* group, int8_t value) {
+    /**
+     * @brief Returns a bitmask with the i-th bit set if the i-th control byte of the group equals `value`.
+     */
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(group[i] == value) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline uint32_t _matchByteAtomic(const int8_t* group, int8_t value) {
+    /**
+     * @brief Like `_matchByte`, but safe to call while the control bytes are being written.
+     */
+    uint32_t mask = 0;
+    for (int w = 0; w < GROUP_WIDTH / 8; w++) {
+        uint64_t word = __atomic_load_n((const uint64_t*)group + w, __ATOMIC_ACQUIRE);
+        int8_t bytes[8];
+        memcpy(bytes, &word, sizeof(bytes));
+        for (int i = 0; i < 8; i++) {
+            mask |= (uint32_t)(bytes[i] == value) << (w * 8 + i);
+        }
+    }
+    return mask;
+}
+
+static inline void _setCtrl(struct _table* table, size_t pos, int8_t value) {
+    /**
+     * @brief Publishes a new control byte, by atomically storing the word it belongs to: concurrent lookups \n
+     * see either the old or the new value and, in the latter case, everything that was written before.
+     */
+    uint64_t* word = (uint64_t*)(table->ctrl + (pos & ~(size_t)7));
+    uint64_t newWord = *word;
+    int8_t bytes[8];
+    memcpy(bytes, &newWord, sizeof(bytes));
+    bytes[pos & 7] = value;
+    memcpy(&newWord, bytes, sizeof(bytes));
+    __atomic_store_n(word, newWord, __ATOMIC_RELEASE);
+}
+
+static struct _table* _allocTable(size_t capacity) {
+    /**
+     * @brief Allocates an empty table with `capacity` slots (a power of two not smaller than `GROUP_WIDTH`).
+     *
+     * @return The table, whose slots and control bytes are part of the same allocation, or NULL if memory couldn't be allocated
+     */
+    struct _table* table = malloc(sizeof(*table) + capacity * sizeof(struct _slot) + capacity);
+    if (!table) {
+        return NULL;
+    }
+    table->slots = (struct _slot*)(table + 1);
+    table->ctrl = (int8_t*)(table->slots + capacity); // 8-byte aligned, as the slots are
+    memset(table->ctrl, CTRL_EMPTY, capacity);
+    table->groupMask = capacity / GROUP_WIDTH - 1;
+    table->used = 0;
+    // keep at least 1/8 of the slots empty, so that unsuccessful probes stay short
+    table->growthLeft = capacity - capacity / 8;
+    return table;
+}
+
+static void _retireTable(FileIndex* index, struct _table* table) {
+    // concurrent lookups might still be searching the table
+    if (index->epochs) {
+        epochRetire(index->epochs, table, free);
+    }
+    else {
+        free(table);
+    }
+}
+
+static size_t _tableFind(const struct _table* table, const char* key, uint64_t hash) {
+    /**
+     * @brief Looks for `key` in the table.
+     *
+     * @return The position of the slot holding the key, or `NOT_FOUND`
+     */
+    size_t group = H1(hash) & table->groupMask;
+    for (size_t step = 1; ; step++) {
+        const int8_t* ctrl = table->ctrl + group * GROUP_WIDTH;
+        for (uint32_t match = _matchByteAtomic(ctrl, H2(hash)); match; match &= match - 1) {
+            size_t pos = group * GROUP_WIDTH + __builtin_ctz(match);
+            if (table->slots[pos].hash == hash && strcmp(table->slots[pos].key, key) == 0) {
+                return pos;
+            }
+        }
+        // an empty slot means the key would have been placed in this group
+        if (_matchByteAtomic(ctrl, CTRL_EMPTY) || step > table->groupMask) {
+            return NOT_FOUND;
+        }
+        // triangular probing visits every group exactly once
+        group = (group + step) & table->groupMask;
+    }
+}
+
+static void _tableInsert(struct _table* table, const char* key, uint64_t hash, void* value) {
+    /**
+     * @brief Puts a key that isn't in the table yet in the first empty slot of its probe sequence.
+     * @note Assumes the table has room for it. Tombstones aren't reused, as a concurrent lookup might still be \n
+     * reading the entry that was removed from the slot.
+     */
+    size_t group = H1(hash) & table->groupMask;
+    uint32_t emptySlots;
+    for (size_t step = 1; !(emptySlots = _matchByte(table->ctrl + group * GROUP_WIDTH, CTRL_EMPTY)); step++) {
+        group = (group + step) & table->groupMask;
+    }
+    size_t pos = group * GROUP_WIDTH + __builtin_ctz(emptySlots);
+
+    assert(table->growthLeft > 0);
+    table->growthLeft -= 1;
+    table->slots[pos] = (struct _slot){ .hash = hash, .key = key, .value = value };
+    _setCtrl(table, pos, H2(hash));
+    table->used += 1;
+}
+
+static void _tableErase(struct _table* table, size_t pos) {
+    // the slot can't be made empty again, even if its group has other empty slots: see `_tableInsert`
+    _setCtrl(table, pos, CTRL_DELETED);
+    table->used -= 1;
+}
+
+static void _migrateStep(FileIndex* index, size_t numGroups) {
+    /**
+     * @brief Moves up to `numGroups` groups from the old table to the current one, and frees the old table
+     * once it's been emptied.
+     */
+    struct _table* old = index->old;
+    if (!old) {
+        return;
+    }
+    for (size_t n = 0; n < numGroups && index->migrateGroup <= old->groupMask; n++, index->migrateGroup++) {
+        size_t base = index->migrateGroup * GROUP_WIDTH;
+        for (size_t pos = base; pos < base + GROUP_WIDTH; pos++) {
+            if (IS_FULL(old->ctrl[pos])) {
+                // lookups search the old table first: the entry is never missing from both
+                _tableInsert(index->curr, old->slots[pos].key, old->slots[pos].hash, old->slots[pos].value);
+                // moved entries become tombstones, as there might be entries in the following groups that probed past this one
+                _setCtrl(old, pos, CTRL_DELETED);
+                old->used -= 1;
+            }
+        }
+    }
+    if (index->migrateGroup > old->groupMask) {
+        __atomic_store_n(&(index->old), NULL, __ATOMIC_RELEASE);
+        _retireTable(index, old);
+    }
+}
+
+static int _startResize(FileIndex* index) {
+    /**
+     * @brief Replaces the current table, which has no empty slots left, with a new one. The new table
+     * is twice as large, unless the current one is mostly filled with tombstones.
+     *
+     * @return 0 on success, -1 if memory for the new table couldn't be allocated
+     */
+    // a resize still in progress would normally be long over by now
+    _migrateStep(index, SIZE_MAX);
+
+    size_t capacity = (index->curr->groupMask + 1) * GROUP_WIDTH;
+    size_t newCapacity = (index->curr->used > capacity / 2 - capacity / 16) ? 2 * capacity : capacity;
+
+    struct _table* newTable = _allocTable(newCapacity);
+    if (!newTable) {
+        return -1;
+    }
+    // lookups that see the new tables also see the new count, and retry if they miss
+    __atomic_add_fetch(&(index->resizes), 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(index->old), index->curr, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(index->curr), newTable, __ATOMIC_SEQ_CST);
+    index->migrateGroup = 0;
+    return 0;
+}
+
+
+FileIndex* allocFileIndex(size_t capacity, EpochDomain* epochs) {
+    /**
+     * @brief Initializes and returns a new empty index.
+     * @param capacity Number of keys the index should be able to hold before growing
+     * @param epochs Domain of the threads that look keys up concurrently with modifications of the index, \n
+     * or NULL if there are none
+     * @return A pointer to the newly created index upon success, NULL on error (sets `errno`)
+     *
+     * Upon error, `errno` will have one of the following values:\n
+     * `ENOMEM`: memory for the index couldn't be allocated
+     */
+    FileIndex* index = calloc(1, sizeof(*index));
+    if (!index) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t actualCapacity = MIN_CAPACITY;
+    while (actualCapacity - actualCapacity / 8 < capacity) {
+        actualCapacity <<= 1;
+    }
+    if (!(index->curr = _allocTable(actualCapacity))) {
+        free(index);
+        errno = ENOMEM;
+        return NULL;
+    }
+    index->epochs = epochs;
+    return index;
+}
+
+int destroyFileIndex(FileIndex* index) {
+    /**
+     * @brief Frees the index. Keys and values aren't owned by the index and aren't freed.
+     *
+     * @note Assumes no lookups are in progress: tables retired earlier are freed along with their epoch domain.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    if (!index) {
+        errno = EINVAL;
+        return -1;
+    }
+    free(index->curr);
+    free(index->old);
+    free(index);
+    return 0;
+}
+
+void* fileIndexFind(FileIndex* index, const char* key, uint64_t hash) {
+    /**
+     * @brief Looks up the value associated with `key`. Doesn't modify the index.
+     * @note Can run concurrently with modifications of the index if the caller is inside an epoch of its domain.
+     *
+     * @param hash The hash of `key`, as returned by `hashPathname`
+     *
+     * @return The value associated with the key, or NULL if the key isn't in the index
+     */
+    size_t resizes;
+    do {
+        resizes = __atomic_load_n(&(index->resizes), __ATOMIC_SEQ_CST);
+        // entries being migrated are inserted in the current table before being removed from the old one
+        struct _table* table = __atomic_load_n(&(index->old), __ATOMIC_SEQ_CST);
+        size_t pos;
+        if (table && (pos = _tableFind(table, key, hash)) != NOT_FOUND) {
+            return table->slots[pos].value;
+        }
+        table = __atomic_load_n(&(index->curr), __ATOMIC_SEQ_CST);
+        if ((pos = _tableFind(table, key, hash)) != NOT_FOUND) {
+            return table->slots[pos].value;
+        }
+    } while (__atomic_load_n(&(index->resizes), __ATOMIC_SEQ_CST) != resizes);
+    return NULL;
+}
+
+int fileIndexInsert(FileIndex* index, const char* key, uint64_t hash, void* value) {
+    /**
+     * @brief Associates `value` to `key`. The key isn't copied: it must stay valid as long as it's in the index.
+     *
+     * @param hash The hash of `key`, as returned by `hashPathname`
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * Upon error, `errno` will have one of the following values:\n
+     * `EEXIST`: the key is already in the index\n
+     * `ENOMEM`: the index needed to grow but memory couldn't be allocated\n
+     * `EINVAL`: invalid parameter(s) were passed
+     */
+    if (!index || !key) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fileIndexFind(index, key, hash)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    _migrateStep(index, MIGRATE_GROUPS);
+    if (!index->curr->growthLeft && _startResize(index) == -1) {
+        errno = ENOMEM;
+        return -1;
+    }
+    _tableInsert(index->curr, key, hash, value);
+    return 0;
+}
+
+int fileIndexRemove(FileIndex* index, const char* key, uint64_t hash) {
+    /**
+     * @brief Removes `key` from the index.
+     *
+     * @param hash The hash of `key`, as returned by `hashPathname`
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * Upon error, `errno` will have one of the following values:\n
+     * `ENOENT`: the key isn't in the index\n
+     * `EINVAL`: invalid parameter(s) were passed
+     */
+    if (!index || !key) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t pos;
+    if ((pos = _tableFind(index->curr, key, hash)) != NOT_FOUND) {
+        _tableErase(index->curr, pos);
+    }
+    else if (index->old && (pos = _tableFind(index->old, key, hash)) != NOT_FOUND) {
+        _tableErase(index->old, pos);
+    }
+    else {
+        errno = ENOENT;
+        return -1;
+    }
+
+    _migrateStep(index, MIGRATE_GROUPS);
+    return 0;
+}
+
+size_t fileIndexSize(const FileIndex* index) {
+    /**
+     * @brief Returns the number of keys in the index.
+     */
+    return index->curr->used + (index->old ? index->old->used : 0);
+}
+
+static size_t _tableFootprint(const struct _table* table) {
+    const size_t capacity = (table->groupMask + 1) * GROUP_WIDTH;
+    return sizeof(*table) + capacity * (sizeof(struct _slot) + 1);
+}
+
+size_t fileIndexFootprint(const FileIndex* index) {
+    /**
+     * @brief Returns the number of bytes of memory used by the index, not counting keys and values.
+     */
+    return sizeof(*index) + _tableFootprint(index->curr) + (index->old ? _tableFootprint(index->old) : 0);
+}
@@ -5,6 +5,16 @@
  *
  *
  * These are the functions that are directly called by the server.
+ *
+ * Files are partitioned among `STORE_SHARDS` shards, each with its own mutex, so that requests on
+ * files belonging to different shards don't contend. Mutexes are always acquired in this order:
+ * eviction mutex, shard mutexes (in index order), file `ordering`, file `mutex`. Files are only destroyed
+ * while no operation is in progress on them: evictions skip the files that are being used rather than wait
+ * for them, as they hold every shard mutex.
+ *
+ * Reads look files up without any shard mutex, from inside an epoch of the storage's `epochs` domain: removed
+ * files are unlinked from their index before their mutexes are released, and only freed once every reader that
+ * might have found them has left its epoch.
  */
 
 
@@ -14,6 +24,7 @@
 #include "../utils/scerrhand.h"
 #include <errno.h>
 #include <assert.h>
+#include <stdint.h>
 #include "../include/filesystemApi.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -21,15 +32,27 @@
 #include "../include/log.h"
 #include "../include/cacheFns.h"
 #include "../include/clientServerProtocol.h"
-#include "../include/rleCompression.h"
+#include "../include/codec.h"
 
 #define MAX(a,b) (a) > (b) ? (a) : (b)
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+#define UPDATE_CACHE_BITS(store, p)\
+    p->lastRef = tickClock(store); \
+    if (store->policy->onAccess) { \
+        touchEvictionOrder(store, getShard(store, p->pathHash), p); \
+    }
 
-#define UPDATE_CACHE_BITS(p)\
-    p->lastRef = time(0); \
-    p->refCount += 1;
+// on a tie, the file that was inserted first is evicted
+#define IS_BETTER_VICTIM(store, candidate, victim) \
+    (!(victim) || (store)->policy->cmp(candidate, victim) > 0 || \
+        ((store)->policy->cmp(candidate, victim) == 0 && (candidate)->insertionSeq < (victim)->insertionSeq))
 
 #define INITIALBUFSIZ 1024
+#define MAX_INITIAL_INDEX_CAPACITY 4096
+#define COMPACTION_THRESHOLD 16 /**< A file is compacted once it has this many more small chunks than after its last compaction */
+#define EVICTION_BATCH_SIZE 16 /**< Max number of files the background evictor evicts without letting other threads in */
+#define IDLE_WAIT_TIMEOUT_MS 50 /**< Threads waiting for files to become evictable check again at least this often */
 
 #define CHECK_INPUT(storePtr, pathname, requestor)\
     if(!storePtr || !strlen(pathname) || requestor <= 0 ) { \
@@ -38,27 +61,209 @@
     }
 
 
-static FileNode_t* getVictim(CacheStorage_t* store, FileNode_t* spare) {
+static StoreShard_t* getShard(const CacheStorage_t* store, const uint64_t pathHash) {
+    // the index of each shard uses the low bits of the hash: pick the shard using the high ones
+    return (StoreShard_t*)&(store->shards[(pathHash >> 32) & (STORE_SHARDS - 1)]);
+}
+
+static uint64_t tickClock(CacheStorage_t* store) {
+    // unlike wall-clock time, no two files inserted or used one after the other get the same tick
+    return __atomic_add_fetch(&(store->clock), 1, __ATOMIC_RELAXED);
+}
+
+static void lockAllShards(CacheStorage_t* store) {
+    /**
+     * @brief Acquires the mutex of every shard, in index order.
+     */
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        DIE_ON_NZ(pthread_mutex_lock(&(store->shards[i].mutex)));
+    }
+}
+
+static void unlockAllShards(CacheStorage_t* store) {
+    for (size_t i = STORE_SHARDS; i > 0; i--) {
+        DIE_ON_NZ(pthread_mutex_unlock(&(store->shards[i - 1].mutex)));
+    }
+}
+
+static void updateMax(size_t* target, const size_t value) {
+    /**
+     * @brief Atomically sets `*target` to `value` if `value` is greater than it.
+     */
+    size_t curr = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (value > curr && !__atomic_compare_exchange_n(target, &curr, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void notifyIdle(CacheStorage_t* store) {
+    /**
+     * @brief Lets the threads that ran out of victims (if any) know that a file might have become evictable, \n
+     * or that room might have been made in the storage.
+     *
+     * @note Must be called after releasing the file's mutexes.
+     */
+    if (__atomic_load_n(&(store->idleWaiters), __ATOMIC_SEQ_CST)) {
+        DIE_ON_NZ(pthread_mutex_lock(&(store->idleMutex)));
+        store->idleGeneration += 1;
+        DIE_ON_NZ(pthread_cond_broadcast(&(store->idleCond)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(store->idleMutex)));
+    }
+}
+
+static void waitForIdle(CacheStorage_t* store, size_t* generation) {
+    /**
+     * @brief Waits until `notifyIdle` is called after `*generation` was read, then updates it.
+     * @details Files whose mutexes are busy when they are looked at aren't evictable, but they might become \n
+     * idle without their thread seeing any waiter: the timeout makes sure those changes aren't missed for long.
+     *
+     * @note The caller must be counted in `idleWaiters`, and must not hold any mutex of the storage.
+     */
+    struct timespec deadline;
+    DIE_ON_NEG_ONE(clock_gettime(CLOCK_REALTIME, &deadline));
+    deadline.tv_nsec += IDLE_WAIT_TIMEOUT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    DIE_ON_NZ(pthread_mutex_lock(&(store->idleMutex)));
+    int err = 0;
+    while (store->idleGeneration == *generation && err != ETIMEDOUT) {
+        err = pthread_cond_timedwait(&(store->idleCond), &(store->idleMutex), &deadline);
+        if (err && err != ETIMEDOUT) {
+            DIE_ON_NZ(err);
+        }
+    }
+    *generation = store->idleGeneration;
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->idleMutex)));
+}
+
+static void addToEvictionOrder(const CacheStorage_t* store, StoreShard_t* shard, FileNode_t* fptr) {
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->evictionOrderMutex)));
+    store->policy->onInsert(shard->evictionState, fptr);
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->evictionOrderMutex)));
+}
+
+static void removeFromEvictionOrder(const CacheStorage_t* store, StoreShard_t* shard, FileNode_t* fptr, bool evicted) {
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->evictionOrderMutex)));
+    store->policy->onRemove(shard->evictionState, fptr, evicted);
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->evictionOrderMutex)));
+}
+
+static void touchEvictionOrder(const CacheStorage_t* store, StoreShard_t* shard, FileNode_t* fptr) {
+    /**
+     * @brief Lets the replacement algorithm know that a file has been used.
+     *
+     * @note Can be called without holding the shard's mutex, but the file must be linked to the storage \n
+     * (e.g. the caller holds the file's mutex)
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->evictionOrderMutex)));
+    store->policy->onAccess(shard->evictionState, fptr);
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->evictionOrderMutex)));
+}
+
+static void resizeEvictionOrder(const CacheStorage_t* store, StoreShard_t* shard, FileNode_t* fptr) {
+    /**
+     * @brief Lets the replacement algorithm know that the size of a file's content has changed.
+     *
+     * @note Assumes the caller holds the file's mutex, and has already updated its `contentSize`
+     */
+    if (!store->policy->onResize) {
+        return;
+    }
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->evictionOrderMutex)));
+    store->policy->onResize(shard->evictionState, fptr);
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->evictionOrderMutex)));
+}
+
+struct victimSearch {
+    FileNode_t* spare; /**< File that should never be chosen as the victim (can be NULL) */
+    size_t busy; /**< Number of files that have been skipped because an operation is in progress on them */
+};
+
+static bool lockIfIdle(FileNode_t* fptr) {
+    /**
+     * @brief Locks the `ordering` and `mutex` of a file if no operation is in progress on it.
+     *
+     * @return `true` if the file is idle (the caller then holds its mutexes), `false` otherwise
+     */
+    // only try locking the file: waiting for operations on it to end would hold up the whole storage,
+    // and other threads might want the mutex of a shard's eviction order while holding the file's mutexes
+    if (!wordTryLock(&(fptr->ordering))) {
+        return false;
+    }
+    if (!wordTryLock(&(fptr->mutex))) {
+        wordUnlock(&(fptr->ordering));
+        return false;
+    }
+    if (fptr->activeReaders || fptr->isBeingWritten) {
+        wordUnlock(&(fptr->ordering));
+        wordUnlock(&(fptr->mutex));
+        return false;
+    }
+    return true;
+}
+
+static bool isIdle(FileNode_t* fptr) {
+    /**
+     * @brief Tells whether no operation is in progress on a file, so that it can be chosen as a victim.
+     *
+     * @note Readers find files without any shard mutex, so one might start reading the file as soon as this returns: \n
+     * the file has to be checked again, with `lockIfIdle`, when it's actually evicted.
+     */
+    if (!lockIfIdle(fptr)) {
+        return false;
+    }
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
+    return true;
+}
+
+static bool isEvictable(FileNode_t* fptr, void* searchPtr) {
+    /**
+     * @brief Tells whether a file can be evicted right away: it isn't the search's `spare` and it's idle.
+     */
+    struct victimSearch* search = searchPtr;
+    if (fptr == search->spare) {
+        return false;
+    }
+    if (!isIdle(fptr)) {
+        search->busy += 1;
+        return false;
+    }
+    return true;
+}
+
+static FileNode_t* getVictim(CacheStorage_t* store, FileNode_t* spare, size_t* busy) {
     /**
      * @brief Runs the replacement algorithm that `store` is using to find a file eligible to be evicted.
      *
+     * Each shard keeps its files in eviction order, so only the candidate proposed by each shard needs \n
+     * to be looked at and the cost doesn't depend on the number of files in the storage. Files that are \n
+     * being read or written are skipped in favour of the next candidate.
+     *
      * @param spare Pointer to a file that should never be chosen as the victim
-     * @note Assumes the caller has mutual exclusion over the store
+     * @param busy If not NULL, set to the number of files that were skipped because they're being used: \n
+     * if there's no victim, that's all the files but `spare`
      *
-     * @return A pointer to the victim
+     * @note Assumes the caller holds the eviction mutex and the mutex of every shard
+     *
+     * @return A pointer to the victim, or `NULL` if there are no idle files other than `spare`
      *
      */
-    FileNode_t* victim = (store->hPtr != spare) ? store->hPtr : store->hPtr->nextPtr;
-    if (store->replacementAlgo != FIFO_ALGO) {
-        FileNode_t* currPtr = store->hPtr;
-        while (currPtr) {
-            if (currPtr != spare && (*cmp_fns[store->replacementAlgo])(currPtr, victim) > 0) {
-                victim = currPtr;
-            }
-            currPtr = currPtr->nextPtr;
+    FileNode_t* victim = NULL;
+    struct victimSearch search = { .spare = spare, .busy = 0 };
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        StoreShard_t* shard = &(store->shards[i]);
+
+        // each shard proposes its best candidate
+        DIE_ON_NZ(pthread_mutex_lock(&(shard->evictionOrderMutex)));
+        FileNode_t* currPtr = store->policy->pickVictim(shard->evictionState, isEvictable, &search);
+        if (currPtr && IS_BETTER_VICTIM(store, currPtr, victim)) {
+            victim = currPtr;
         }
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->evictionOrderMutex)));
+    }
+    if (busy) {
+        *busy = search.busy;
     }
-    store->numVictims += 1;
     return victim;
 
 }
@@ -204,36 +409,154 @@ static int popNodeFromFdQueue(struct fdNode** listPtr, int fd) {
 void deallocFile(FileNode_t* fptr) {
     assert(fptr);
 
-    free(fptr->pathname);
-    free(fptr->content);
+    if (fptr->pathname != fptr->shortPathname) {
+        free(fptr->pathname);
+    }
+    releaseContent(fptr->content);
+
+    slabFree(fptr);
+}
+
+static void deallocFileFn(void* fptr) {
+    deallocFile((FileNode_t*)fptr);
+}
+
+void retireFile(CacheStorage_t* store, FileNode_t* fptr) {
+    /**
+     * @brief Frees a file that has been removed from the storage, as soon as no reader can be looking at it anymore. \n
+     * Its content, if it still has any, is released right away.
+     */
+    assert(store && fptr);
+    // readers that find a removed file don't look at its content
+    releaseContent(fptr->content);
+    fptr->content = NULL;
+    epochRetire(store->epochs, fptr, deallocFileFn);
+}
+
+static void dropHotImage(StoreShard_t* shard, FileNode_t* fptr) {
+    // removes the file's image, if any, from the hot cache; assumes the caller holds the shard's `hotMutex`
+    if (!fptr->image) {
+        return;
+    }
+    if (fptr->hotPrev) {
+        fptr->hotPrev->hotNext = fptr->hotNext;
+    }
+    else {
+        shard->hotHead = fptr->hotNext;
+    }
+    if (fptr->hotNext) {
+        fptr->hotNext->hotPrev = fptr->hotPrev;
+    }
+    else {
+        shard->hotTail = fptr->hotPrev;
+    }
+    fptr->hotPrev = fptr->hotNext = NULL;
+    shard->hotBytes -= fptr->image->size;
+    releaseSharedBuffer(fptr->image); // readers that are still sending the image hold references of their own
+    fptr->image = NULL;
+    fptr->imageOf = NULL;
+}
 
-    free(fptr);
+static void invalidateHotImage(StoreShard_t* shard, FileNode_t* fptr) {
+    /**
+     * @brief Drops the file's cached image, if any: to be called whenever a new version of the content of the file \n
+     * is published, or the file is destroyed.
+     *
+     * @note Assumes the caller holds the file's mutex.
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->hotMutex)));
+    dropHotImage(shard, fptr);
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->hotMutex)));
 }
 
-static void destroyFile(CacheStorage_t* store, FileNode_t* fptr, struct fdNode** notifyList, bool deallocMem) {
+static SharedBuffer_t* getHotImage(CacheStorage_t* store, StoreShard_t* shard, FileNode_t* fptr, const FileContent_t* content) {
+    /**
+     * @brief Returns a new reference to the file's cached image of the given version of its content, moving it \n
+     * to the front of the hot cache, or NULL if the image isn't cached.
+     *
+     * @note Assumes the caller holds a reference to `content`, so that its address can't be reused by a newer version.
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->hotMutex)));
+    SharedBuffer_t* image = (fptr->imageOf == content) ? fptr->image : NULL;
+    if (image) {
+        acquireSharedBuffer(image);
+        if (fptr != shard->hotHead) {
+            fptr->hotPrev->hotNext = fptr->hotNext;
+            if (fptr->hotNext) {
+                fptr->hotNext->hotPrev = fptr->hotPrev;
+            }
+            else {
+                shard->hotTail = fptr->hotPrev;
+            }
+            fptr->hotPrev = NULL;
+            fptr->hotNext = shard->hotHead;
+            shard->hotHead->hotPrev = fptr;
+            shard->hotHead = fptr;
+        }
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->hotMutex)));
+    if (image) {
+        __atomic_add_fetch(&(store->numHotReads), 1, __ATOMIC_RELAXED);
+    }
+    return image;
+}
+
+static void cacheHotImage(const CacheStorage_t* store, StoreShard_t* shard, FileNode_t* fptr, const FileContent_t* content, SharedBuffer_t* image) {
+    /**
+     * @brief Caches `image`, the decompressed `content` of the file, dropping the least recently read images \n
+     * of the shard to keep the hot cache within its budget. Images larger than the whole budget aren't cached.
+     *
+     * @note Assumes the caller holds a reference to `content`. Stale images are never cached: writers publish \n
+     * a new version before invalidating the image of the old one, so the check below either sees the new \n
+     * version or runs before the invalidation.
+     */
+    if (!image->size || image->size > store->hotCacheShardBudget) {
+        return;
+    }
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->hotMutex)));
+    // another reader might have beaten us to it
+    if (!fptr->image && __atomic_load_n(&(fptr->content), __ATOMIC_ACQUIRE) == content) {
+        while (shard->hotBytes + image->size > store->hotCacheShardBudget) {
+            dropHotImage(shard, shard->hotTail);
+        }
+        acquireSharedBuffer(image);
+        fptr->image = image;
+        fptr->imageOf = content;
+        fptr->hotPrev = NULL;
+        fptr->hotNext = shard->hotHead;
+        if (shard->hotHead) {
+            shard->hotHead->hotPrev = fptr;
+        }
+        else {
+            shard->hotTail = fptr;
+        }
+        shard->hotHead = fptr;
+        shard->hotBytes += image->size;
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->hotMutex)));
+}
+
+static void destroyFile(CacheStorage_t* store, FileNode_t* fptr, struct fdNode** notifyList, bool deallocMem, bool evicted) {
     /**
      * @brief Handles eviction of a file from the storage.
-     * @note Assumes the caller thread has mutual exclusion over the store. Returns memory allocated on the heap that \n
-     * needs to be `free`d.
+     * @note Assumes the caller thread holds the mutex of the shard the file belongs to, as well as the file's `ordering` \n
+     * and `mutex`, and that no operation is in progress on the file; the file's mutexes are released. Returns memory \n
+     * allocated on the heap that needs to be `free`d.
      *
      * @param store A pointer to the storage containing the file
      * @param fptr A pointer to the file to delete
      * @param notifyList A pointer to a list of file descriptors that were waiting to gain lock of this file. \n
      * *Note*: the caller needs to `free` the list at a later point
      * @param deallocMem If `false`, the file will be removed from the storage but it won't be `free`d. This allows \n
-     * the caller to retain a pointer to the file and `free` it later. This is used for sending evicted files back to the client
+     * the caller to retain a pointer to the file and `retireFile` it later. This is used for sending evicted files back to the client
+     * @param evicted Whether the file is being removed by the replacement algorithm rather than on request
      *
      */
 
     assert(fptr);
     assert(store);
 
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
-
-    while (fptr->activeReaders > 0 || fptr->isBeingWritten) {
-        DIE_ON_NZ(pthread_cond_wait(&(fptr->rwCond), &(fptr->mutex)));
-    }
+    StoreShard_t* shard = getShard(store, fptr->pathHash);
 
     // remove file from the storage list: it's now out of scope and the only
     // way to access it is by having a pointer to it
@@ -241,16 +564,20 @@ static void destroyFile(CacheStorage_t* store, FileNode_t* fptr, struct fdNode**
         fptr->prevPtr->nextPtr = fptr->nextPtr;
     }
     else {
-        store->hPtr = fptr->nextPtr;
+        shard->hPtr = fptr->nextPtr;
     }
 
     if (fptr->nextPtr) {
         fptr->nextPtr->prevPtr = fptr->prevPtr;
     }
     else {
-        store->tPtr = fptr->prevPtr;
+        shard->tPtr = fptr->prevPtr;
     }
 
+    fptr->removed = true;
+    removeFromEvictionOrder(store, shard, fptr, evicted);
+    invalidateHotImage(shard, fptr);
+
     // give back to caller the list of clients that were waiting to gain lock of this file;
     // the list needs to be later freed by caller
     if (fptr->pendingLocks_hPtr && notifyList) {
@@ -265,27 +592,41 @@ static void destroyFile(CacheStorage_t* store, FileNode_t* fptr, struct fdNode**
     }
 
     // there are no more pending requests on the file: file is now safe to delete
-    store->currFileNum -= 1;
-    store->currStorageSize -= fptr->contentSize;
+    __atomic_sub_fetch(&(store->currFileNum), 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&(store->currStorageSize), fptr->contentSize, __ATOMIC_RELAXED);
 
-    DIE_ON_NZ(pthread_cond_destroy(&(fptr->rwCond)));
+    // delete from dictionary: readers that find the file from now on, before it's retired, see it's been removed
+    DIE_ON_NEG_ONE(fileIndexRemove(shard->dictStore, fptr->pathname, fptr->pathHash));
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
-
-    DIE_ON_NZ(pthread_mutex_destroy(&(fptr->mutex)));
-    DIE_ON_NZ(pthread_mutex_destroy(&(fptr->ordering)));
+    if (deallocMem) {
+        // readers only look at the content after checking the file hasn't been removed, and those that were already
+        // reading it hold references of their own: the content doesn't have to wait for the node to be reclaimed
+        releaseContent(fptr->content);
+        fptr->content = NULL;
+    }
 
-    // delete from dictionary
-    DIE_ON_NZ(icl_hash_delete(store->dictStore, fptr->pathname, NULL, NULL));
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
+    notifyIdle(store);
 
     if (deallocMem) {
-        deallocFile(fptr);
+        retireFile(store, fptr);
     }
 }
 
 
-CacheStorage_t* allocStorage(const size_t maxFileNum, const size_t maxStorageSize, const short replacementAlgo) {
+CacheStorage_t* allocStorage(const size_t maxFileNum, const size_t maxStorageSize, const short replacementAlgo, const long replacementOption, const bool admissionFilter) {
+    /**
+     * @param replacementAlgo One of the `*_ALGO` constants
+     * @param replacementOption Passed to the replacement algorithm (e.g. `GDSF_BYTE_HIT_RATIO`); ignored by algorithms without options
+     * @param admissionFilter Whether new files should only be allowed to replace files that are requested less often than them
+     *
+     * @return A pointer to the new storage, or NULL on error (sets `errno`)
+     */
+    if (replacementAlgo < 0 || replacementAlgo >= NUM_REPLACEMENT_ALGOS) {
+        errno = EINVAL;
+        return NULL;
+    }
     CacheStorage_t* newStore = calloc(sizeof(*newStore), 1);
     if (!newStore) {
         errno = ENOMEM;
@@ -297,15 +638,77 @@ CacheStorage_t* allocStorage(const size_t maxFileNum, const size_t maxStorageSiz
         errno = ENOMEM;
         return NULL;
     }
-    newStore->dictStore = icl_hash_create(maxFileNum / 10 + 1, NULL, NULL);
-    if (!newStore->dictStore) {
-        free(newStore->logBuffer);
+    if (admissionFilter && !(newStore->admissionSketch = allocFrequencySketch(maxFileNum))) {
+        destroyBoundedBuffer(newStore->logBuffer);
         free(newStore);
         errno = ENOMEM;
         return NULL;
     }
-
-    DIE_ON_NZ(pthread_mutex_init(&(newStore->mutex), NULL));
+    newStore->policy = evictionPolicies[replacementAlgo];
+    newStore->defaultCodec = CODEC_LZ;
+    if (newStore->policy->allocShared && !(newStore->evictionShared = newStore->policy->allocShared(replacementOption))) {
+        int errnosave = errno;
+        if (newStore->admissionSketch) {
+            destroyFrequencySketch(newStore->admissionSketch);
+        }
+        destroyBoundedBuffer(newStore->logBuffer);
+        free(newStore);
+        errno = errnosave;
+        return NULL;
+    }
+    if (!(newStore->epochs = allocEpochDomain()) || !(newStore->fileSlab = allocSlabAllocator(sizeof(FileNode_t)))) {
+        if (newStore->epochs) {
+            destroyEpochDomain(newStore->epochs);
+        }
+        if (newStore->evictionShared) {
+            newStore->policy->destroyShared(newStore->evictionShared);
+        }
+        if (newStore->admissionSketch) {
+            destroyFrequencySketch(newStore->admissionSketch);
+        }
+        destroyBoundedBuffer(newStore->logBuffer);
+        free(newStore);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        // indexes grow as needed: don't preallocate huge ones for large file counts
+        newStore->shards[i].dictStore = allocFileIndex(MIN(maxFileNum / STORE_SHARDS + 1, MAX_INITIAL_INDEX_CAPACITY), newStore->epochs);
+        newStore->shards[i].evictionState = newStore->policy->allocState(newStore->evictionShared);
+        if (!newStore->shards[i].dictStore || !newStore->shards[i].evictionState) {
+            do {
+                if (newStore->shards[i].dictStore) {
+                    destroyFileIndex(newStore->shards[i].dictStore);
+                }
+                if (newStore->shards[i].evictionState) {
+                    newStore->policy->destroyState(newStore->shards[i].evictionState);
+                }
+            } while (i-- > 0);
+            destroyEpochDomain(newStore->epochs);
+            destroySlabAllocator(newStore->fileSlab);
+            if (newStore->evictionShared) {
+                newStore->policy->destroyShared(newStore->evictionShared);
+            }
+            if (newStore->admissionSketch) {
+                destroyFrequencySketch(newStore->admissionSketch);
+            }
+            destroyBoundedBuffer(newStore->logBuffer);
+            free(newStore);
+            errno = ENOMEM;
+            return NULL;
+        }
+        DIE_ON_NZ(pthread_mutex_init(&(newStore->shards[i].mutex), NULL));
+        DIE_ON_NZ(pthread_mutex_init(&(newStore->shards[i].evictionOrderMutex), NULL));
+        DIE_ON_NZ(pthread_mutex_init(&(newStore->shards[i].hotMutex), NULL));
+    }
+
+    DIE_ON_NZ(pthread_mutex_init(&(newStore->evictionMutex), NULL));
+    DIE_ON_NZ(pthread_mutex_init(&(newStore->idleMutex), NULL));
+    DIE_ON_NZ(pthread_cond_init(&(newStore->idleCond), NULL));
+    DIE_ON_NZ(pthread_mutex_init(&(newStore->evictorMutex), NULL));
+    DIE_ON_NZ(pthread_cond_init(&(newStore->evictorCond), NULL));
+    DIE_ON_NZ(pthread_mutex_init(&(newStore->compactorMutex), NULL));
+    DIE_ON_NZ(pthread_cond_init(&(newStore->compactorCond), NULL));
     newStore->maxFileNum = maxFileNum;
     newStore->maxStorageSize = maxStorageSize;
     newStore->replacementAlgo = replacementAlgo;
@@ -321,56 +724,112 @@ int destroyStorage(CacheStorage_t* store) {
         errno = EINVAL;
         return -1;
     }
-    // free all files
+    // free all files and destroy the shards
     FileNode_t* tmp;
 
-    while (store->hPtr) {
-        tmp = store->hPtr;
-        store->hPtr = store->hPtr->nextPtr;
-        destroyFile(store, tmp, NULL, true);
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        StoreShard_t* shard = &(store->shards[i]);
+        while (shard->hPtr) {
+            tmp = shard->hPtr;
+            wordLock(&(tmp->ordering));
+            wordLock(&(tmp->mutex));
+            destroyFile(store, tmp, NULL, true, false);
+        }
+        destroyFileIndex(shard->dictStore);
+        store->policy->destroyState(shard->evictionState);
+        DIE_ON_NEG_ONE(pthread_mutex_destroy(&(shard->mutex)));
+        DIE_ON_NEG_ONE(pthread_mutex_destroy(&(shard->evictionOrderMutex)));
+        DIE_ON_NEG_ONE(pthread_mutex_destroy(&(shard->hotMutex)));
     }
 
     // destroy data structures and mutex
+    if (store->evictionShared) {
+        store->policy->destroyShared(store->evictionShared);
+    }
+    if (store->admissionSketch) {
+        destroyFrequencySketch(store->admissionSketch);
+    }
     destroyBoundedBuffer(store->logBuffer);
-    icl_hash_destroy(store->dictStore, NULL, NULL);
-    DIE_ON_NEG_ONE(pthread_mutex_destroy(&(store->mutex)));
+    DIE_ON_NEG_ONE(pthread_mutex_destroy(&(store->evictionMutex)));
+    DIE_ON_NEG_ONE(pthread_mutex_destroy(&(store->idleMutex)));
+    DIE_ON_NEG_ONE(pthread_cond_destroy(&(store->idleCond)));
+    DIE_ON_NEG_ONE(pthread_mutex_destroy(&(store->evictorMutex)));
+    DIE_ON_NEG_ONE(pthread_cond_destroy(&(store->evictorCond)));
+    while (store->compactionHead) {
+        struct compactionRequest* tmp = store->compactionHead;
+        store->compactionHead = tmp->nextPtr;
+        free(tmp->pathname);
+        free(tmp);
+    }
+    DIE_ON_NEG_ONE(pthread_mutex_destroy(&(store->compactorMutex)));
+    DIE_ON_NEG_ONE(pthread_cond_destroy(&(store->compactorCond)));
+    // frees the files and index tables that were retired
+    destroyEpochDomain(store->epochs);
+    destroySlabAllocator(store->fileSlab);
 
     free(store);
     return 0;
 }
 
+void storageOverhead(CacheStorage_t* store, StorageOverhead_t* overhead) {
+    /**
+     * @brief Measures the memory used to keep track of the files in the storage, besides their compressed content.
+     * @details What each file costs (its node, its pathname if it doesn't fit in the node and the metadata of its \n
+     * content) is kept apart from what's allocated in advance: the index tables, sized for the files the storage \n
+     * can hold, and the part of the nodes' slabs that isn't used by the files in the storage.
+     *
+     * @note Assumes only one thread has access to the store.
+     */
+    memset(overhead, 0, sizeof(*overhead));
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        overhead->preallocatedBytes += fileIndexFootprint(store->shards[i].dictStore);
+        for (FileNode_t* fptr = store->shards[i].hPtr; fptr; fptr = fptr->nextPtr) {
+            overhead->numFiles += 1;
+            overhead->nodeBytes += sizeof(*fptr);
+            if (fptr->pathname != fptr->shortPathname) {
+                overhead->pathnameBytes += strlen(fptr->pathname) + 1;
+            }
+            overhead->contentBytes += contentOverhead(fptr->content);
+        }
+    }
+    overhead->preallocatedBytes += slabFootprint(store->fileSlab) - overhead->nodeBytes;
+}
+
 
-static FileNode_t* allocFile(const char* pathname) {
-    FileNode_t* newFile = calloc(sizeof(*newFile), 1);
+static FileNode_t* allocFile(CacheStorage_t* store, const char* pathname, const uint64_t pathHash, const unsigned char codec) {
+    FileNode_t* newFile = slabAlloc(store->fileSlab);
     if (!newFile) {
         errno = ENOMEM;
         return NULL;
     }
 
-    newFile->pathname = malloc(INITIALBUFSIZ);
-    newFile->content = calloc(INITIALBUFSIZ, 1);
-    newFile->insertionTime = time(0);
+    const size_t pathnameSize = strlen(pathname) + 1;
+    newFile->pathname = (pathnameSize <= SHORT_PATHNAME_LEN) ? newFile->shortPathname : malloc(pathnameSize);
+    newFile->numOpens = 1;
 
-    if (!newFile->pathname || !newFile->content) {
+    if (!newFile->pathname) {
+        slabFree(newFile);
         errno = ENOMEM;
         return NULL;
     }
 
-    DIE_ON_NZ(pthread_mutex_init(&(newFile->mutex), NULL));
-
-    strncpy(newFile->pathname, pathname, INITIALBUFSIZ);
+    memcpy(newFile->pathname, pathname, pathnameSize);
+    newFile->pathHash = pathHash;
+    newFile->codec = codec;
 
     return newFile;
 }
 
-static FileNode_t* findFile(const CacheStorage_t* store, const char* pathname) {
+static FileNode_t* findFile(const CacheStorage_t* store, const char* pathname, const uint64_t pathHash) {
     /**
      * @brief Looks for a file in the storage.
      *
-     * @note Assumes the caller has mutual exclusion over the store.
+     * @note Assumes the caller holds the mutex of the shard `pathname` belongs to, or is inside an epoch of `store->epochs`: \n
+     * in the latter case, the file might be removed at any time, and has to be checked with its mutex held.
      *
      * @param store A pointer to the storage to search
      * @param pathname The absolute pathname of the file to look for
+     * @param pathHash `hashPathname(pathname)`
      * @return A pointer to the found file, or `NULL` if no file could be found or an error occurred (sets `errno`)
      *
      * `errno` values: \n
@@ -384,7 +843,7 @@ static FileNode_t* findFile(const CacheStorage_t* store, const char* pathname) {
     }
 
 
-    void* ret = icl_hash_find(store->dictStore, (void*)pathname);
+    void* ret = fileIndexFind(getShard(store, pathHash)->dictStore, pathname, pathHash);
     if (!ret) {
         errno = ENOENT;
     }
@@ -393,40 +852,483 @@ static FileNode_t* findFile(const CacheStorage_t* store, const char* pathname) {
 
 
 void printStore(const CacheStorage_t* store) {
-    FileNode_t* currptr = store->hPtr;
-    while (currptr) {
-        puts(currptr->pathname);
-        currptr = currptr->nextPtr;
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        FileNode_t* currptr = store->shards[i].hPtr;
+        while (currptr) {
+            puts(currptr->pathname);
+            currptr = currptr->nextPtr;
+        }
     }
 }
 
 void addFileToStore(CacheStorage_t* store, FileNode_t* filePtr) {
     /**
-     * @note Operates under the assumption that the caller has mutual exclusion over the store
+     * @note Operates under the assumption that the caller holds the mutex of the shard the file belongs to, \n
+     * and that a slot for the file has already been reserved with `makeRoom`
      *
      */
+    StoreShard_t* shard = getShard(store, filePtr->pathHash);
+    filePtr->insertionSeq = __atomic_fetch_add(&(store->insertionCounter), 1, __ATOMIC_RELAXED);
+    filePtr->insertionTime = filePtr->lastRef = tickClock(store);
 
-     // add file to list structure
-    if (!store->hPtr) {
-        store->hPtr = filePtr;
+    // add file to list structure
+    if (!shard->hPtr) {
+        shard->hPtr = filePtr;
 
     }
     else {
-        filePtr->prevPtr = store->tPtr;
-        if (store->tPtr) {
-            store->tPtr->nextPtr = filePtr;
+        filePtr->prevPtr = shard->tPtr;
+        if (shard->tPtr) {
+            shard->tPtr->nextPtr = filePtr;
         }
     }
-    store->tPtr = filePtr;
+    shard->tPtr = filePtr;
+
+    addToEvictionOrder(store, shard, filePtr);
 
     // add file to dict structure
-    DIE_ON_NULL(icl_hash_insert(store->dictStore, filePtr->pathname, filePtr));
+    DIE_ON_NEG_ONE(fileIndexInsert(shard->dictStore, filePtr->pathname, filePtr->pathHash, filePtr));
+    notifyIdle(store);
+}
+
+static void queueCompaction(CacheStorage_t* store, const char* pathname, const uint64_t pathHash) {
+    /**
+     * @brief Asks the background compactor to merge the small chunks of a file.
+     * @details Files are looked up again by pathname once their turn comes, as they might have been removed in the meantime.
+     */
+    struct compactionRequest* request = malloc(sizeof(*request));
+    if (!request || !(request->pathname = strdup(pathname))) {
+        // compaction only saves memory: it's fine to skip it
+        free(request);
+        return;
+    }
+    request->pathHash = pathHash;
+    request->nextPtr = NULL;
+
+    DIE_ON_NZ(pthread_mutex_lock(&(store->compactorMutex)));
+    if (store->compactionTail) {
+        store->compactionTail->nextPtr = request;
+    }
+    else {
+        store->compactionHead = request;
+    }
+    store->compactionTail = request;
+    DIE_ON_NZ(pthread_cond_signal(&(store->compactorCond)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->compactorMutex)));
+}
+
+static bool reserveFileSlots(CacheStorage_t* store, const size_t newFiles) {
+    /**
+     * @brief Atomically adds `newFiles` to the number of files in the storage, unless that would exceed its limit.
+     *
+     * @return `true` if the slots have been reserved, `false` otherwise
+     */
+    size_t curr = __atomic_load_n(&(store->currFileNum), __ATOMIC_RELAXED);
+    do {
+        if (curr + newFiles > store->maxFileNum) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&(store->currFileNum), &curr, curr + newFiles, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    updateMax(&(store->maxReachedFileNum), curr + newFiles);
+    return true;
+}
+
+static void wakeEvictor(CacheStorage_t* store) {
+    /**
+     * @brief Wakes up the background evictor if the storage has gone past one of its high watermarks.
+     */
+    if (!store->backgroundEviction) {
+        return;
+    }
+    if (__atomic_load_n(&(store->currFileNum), __ATOMIC_RELAXED) > store->highWatermarkFileNum ||
+        __atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED) > store->highWatermarkStorageSize) {
+        // only the first thread to notice has to signal the evictor
+        if (!__atomic_exchange_n(&(store->evictionRequested), true, __ATOMIC_RELAXED)) {
+            DIE_ON_NZ(pthread_mutex_lock(&(store->evictorMutex)));
+            DIE_ON_NZ(pthread_cond_signal(&(store->evictorCond)));
+            DIE_ON_NZ(pthread_mutex_unlock(&(store->evictorMutex)));
+        }
+    }
+}
+
+static bool evictFile(CacheStorage_t* store, FileNode_t* victim, FileNode_t** evictedList, struct fdNode** notifyList, const int requestor) {
+    /**
+     * @brief Removes `victim` from the storage to make room for other files, unless an operation has started on it \n
+     * since it was chosen: then it's left alone, and the next search for a victim skips it.
+     *
+     * @note Assumes the caller holds `evictionMutex` and the mutex of every shard.
+     *
+     * @return `true` if the file has been evicted, `false` if it's being used
+     */
+    struct fdNode* tmpList = NULL; // will hold a list of fd's that were waiting on this file before it got deleted
+
+    if (!lockIfIdle(victim)) {
+        return false;
+    }
+
+    logEvent(store->logBuffer, "EVICTED", victim->pathname, 0, requestor, 0);
+    destroyFile(store, victim, &tmpList, !evictedList, true);
+
+    if (evictedList) {
+        // build a list of evicted files
+        victim->nextPtr = *evictedList;
+        *evictedList = victim;
+    }
+
+    // make a single list with all the clients that need to be notified that a file they were blocked on doesn't exist (anymore)
+    concatenateFdLists(notifyList, tmpList);
+    store->numVictims += 1;
+    return true;
+}
+
+static size_t pendingCreations(CacheStorage_t* store) {
+    /**
+     * @brief Returns the number of file slots that have been reserved for files that haven't been added to the storage yet.
+     *
+     * @note Assumes the caller holds the mutex of every shard.
+     */
+    size_t linked = 0;
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        linked += fileIndexSize(store->shards[i].dictStore);
+    }
+    return __atomic_load_n(&(store->currFileNum), __ATOMIC_RELAXED) - linked;
+}
+
+static bool makeRoom(CacheStorage_t* store, const size_t newFiles, const char* spare, const char* newcomer, const uint64_t pathHash, FileNode_t** evictedList, struct fdNode** notifyList, const int requestor) {
+    /**
+     * @brief Evicts files until the storage is within its limits, then reserves `newFiles` file slots.
+     *
+     * If the admission filter is enabled and `newcomer` isn't NULL, each file is only evicted to make room \n
+     * for it if the newcomer has been requested at least as many times. As soon as a victim is worth more, either \n
+     * the newcomer itself is evicted (if it's `spare`), or no more files are evicted and no slots are reserved; \n
+     * the files evicted until then stay evicted, as each of them was worth less than the newcomer.
+     *
+     * @param newFiles Number of file slots to reserve for files that are about to be created
+     * @param spare Pathname of a file that should never be chosen as a victim (can be NULL). The file is looked up \n
+     * again every time the shards are locked, as it might be removed whenever they aren't.
+     * @param newcomer Pathname of a file that isn't in the storage yet, or `spare` if it has just received its first content (can be NULL)
+     * @param pathHash `hashPathname(spare)` and/or `hashPathname(newcomer)`
+     * @param evictedList If not NULL, the evicted files are unlinked from the storage but not `free`d and are \n
+     * put in this list instead, so that they can be sent back to the client
+     * @param notifyList Output parameter: the clients that were waiting to lock one of the evicted files are appended to this list
+     *
+     * @note The caller must not hold any shard mutex. Files that are being read or written aren't evicted: \n
+     * if they're the only ones left, the caller lets go of the storage and waits for the operations on them to finish.
+     *
+     * @return `false` if the newcomer has been rejected by the admission filter, or if there's nothing left to evict \n
+     * (no slots are reserved then), `true` otherwise
+     */
+    bool checkAdmission = newcomer && store->admissionSketch;
+    bool admitted = true;
+    bool waiting = false; // whether we're counted in `idleWaiters`
+    size_t generation = 0;
+
+    // nothing needs to be evicted: don't stop the other threads
+    if (__atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED) <= store->maxStorageSize && reserveFileSlots(store, newFiles)) {
+        wakeEvictor(store);
+        return true;
+    }
+
+    DIE_ON_NZ(pthread_mutex_lock(&(store->evictionMutex)));
+    lockAllShards(store);
+    StoreShard_t* spareShard = getShard(store, pathHash);
+
+    while (__atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED) > store->maxStorageSize || !reserveFileSlots(store, newFiles)) {
+        FileNode_t* spareFile = spare ? fileIndexFind(spareShard->dictStore, spare, pathHash) : NULL;
+        size_t busy;
+        FileNode_t* victim = getVictim(store, spareFile, &busy);
+        if (!victim && !busy && !pendingCreations(store)) {
+            // there's nothing but `spare`, and no operation in progress could change that: waiting wouldn't help
+            admitted = false;
+            break;
+        }
+        if (!victim && !waiting) {
+            // from now on, threads that make a file evictable let us know: look again, in case one did before
+            waiting = true;
+            __atomic_add_fetch(&(store->idleWaiters), 1, __ATOMIC_SEQ_CST);
+            DIE_ON_NZ(pthread_mutex_lock(&(store->idleMutex)));
+            generation = store->idleGeneration;
+            DIE_ON_NZ(pthread_mutex_unlock(&(store->idleMutex)));
+            continue;
+        }
+        if (!victim) {
+            // the files left are either being used or still being created by other threads: let them
+            // (and other evictions) go on without us until one is done, so that its file can be evicted
+            unlockAllShards(store);
+            DIE_ON_NZ(pthread_mutex_unlock(&(store->evictionMutex)));
+            waitForIdle(store, &generation);
+            DIE_ON_NZ(pthread_mutex_lock(&(store->evictionMutex)));
+            lockAllShards(store);
+            continue;
+        }
+        if (checkAdmission && frequencySketchEstimate(store->admissionSketch, pathHash) < frequencySketchEstimate(store->admissionSketch, victim->pathHash)) {
+            // the newcomer isn't worth as much as the file it would replace
+            checkAdmission = false;
+            store->numRejected += 1;
+            if (!spare) {
+                admitted = false;
+                break;
+            }
+            // `spare` might have been removed before we got the locks, or be in use: in that case, evict the victim
+            if (spareFile && isIdle(spareFile)) {
+                victim = spareFile;
+                spare = NULL;
+            }
+        }
+        // a reader might have got to the victim since it was chosen: then the next search picks another one
+        evictFile(store, victim, evictedList, notifyList, requestor);
+    }
+
+    updateMax(&(store->maxReachedStorageSize), __atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED));
+
+    unlockAllShards(store);
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->evictionMutex)));
+    if (waiting) {
+        __atomic_sub_fetch(&(store->idleWaiters), 1, __ATOMIC_SEQ_CST);
+    }
+    // the thread might not retire or read anything for a while: free the evicted files that can be freed already
+    epochReclaim(store->epochs);
+    wakeEvictor(store);
+    return admitted;
+}
+
+int setEvictionWatermarks(CacheStorage_t* store, const size_t highWatermark, const size_t lowWatermark) {
+    /**
+     * @brief Enables background eviction: once the number of files or the size of the storage goes past `highWatermark` \n
+     * percent of its limit, files are evicted until both are within `lowWatermark` percent of their limits.
+     *
+     * @note Must be called before any other thread has access to the storage; the eviction itself is carried out by \n
+     * a thread that repeatedly calls `evictInBackground`.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `EINVAL` the watermarks aren't such that 0 <= `lowWatermark` < `highWatermark` <= 100
+     */
+    if (!store || lowWatermark >= highWatermark || highWatermark > 100) {
+        errno = EINVAL;
+        return -1;
+    }
+    store->highWatermarkFileNum = store->maxFileNum * highWatermark / 100;
+    store->highWatermarkStorageSize = store->maxStorageSize / 100 * highWatermark + store->maxStorageSize % 100 * highWatermark / 100;
+    store->lowWatermarkFileNum = store->maxFileNum * lowWatermark / 100;
+    store->lowWatermarkStorageSize = store->maxStorageSize / 100 * lowWatermark + store->maxStorageSize % 100 * lowWatermark / 100;
+    store->backgroundEviction = true;
+    return 0;
+}
+
+int setDefaultCodec(CacheStorage_t* store, const unsigned char codec) {
+    /**
+     * @brief Sets the codec the content of new files is compressed with (`CODEC_LZ` by default).
+     *
+     * @note Must be called before any other thread has access to the storage.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `EINVAL` `codec` isn't one of the `CODEC_*` constants
+     */
+    if (!store || codec >= NUM_CODECS) {
+        errno = EINVAL;
+        return -1;
+    }
+    store->defaultCodec = codec;
+    return 0;
+}
+
+int setHotCacheSize(CacheStorage_t* store, const size_t maxHotCacheSize) {
+    /**
+     * @brief Enables the hot cache: the decompressed content of the most read files is kept around, up to \n
+     * `maxHotCacheSize` bytes in total (split evenly among the shards), so that reading them again doesn't \n
+     * decompress anything. The cache is disabled by default.
+     *
+     * @note Must be called before any other thread has access to the storage. The images aren't counted in \n
+     * the size of the storage.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `EINVAL` invalid parameters
+     */
+    if (!store) {
+        errno = EINVAL;
+        return -1;
+    }
+    store->hotCacheShardBudget = maxHotCacheSize / STORE_SHARDS;
+    return 0;
+}
+
+bool evictInBackground(CacheStorage_t* store, struct fdNode** notifyList) {
+    /**
+     * @brief Waits until the storage goes past one of its high watermarks, then evicts files until it's within \n
+     * both of its low watermarks.
+     * @details Files are evicted in batches of `EVICTION_BATCH_SIZE`, so that requests aren't held up for the whole \n
+     * time it takes to get back to the low watermarks.
+     *
+     * @param notifyList Output parameter: the clients that were waiting to lock one of the evicted files are appended to this list
+     *
+     * @return `false` if `stopBackgroundEviction` has been called, `true` otherwise
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(store->evictorMutex)));
+    while (!store->evictorExit && !__atomic_load_n(&(store->evictionRequested), __ATOMIC_RELAXED)) {
+        DIE_ON_NZ(pthread_cond_wait(&(store->evictorCond), &(store->evictorMutex)));
+    }
+    const bool mustExit = store->evictorExit;
+    __atomic_store_n(&(store->evictionRequested), false, __ATOMIC_RELAXED);
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->evictorMutex)));
+
+    if (mustExit) {
+        return false;
+    }
+
+    bool done = false;
+    while (!done) {
+        DIE_ON_NZ(pthread_mutex_lock(&(store->evictionMutex)));
+        lockAllShards(store);
+        for (size_t i = 0; i < EVICTION_BATCH_SIZE && !done; i++) {
+            FileNode_t* victim = NULL;
+            // if there are no victims, the files left are being used or created: they'll wake us up again if needed
+            done = (__atomic_load_n(&(store->currFileNum), __ATOMIC_RELAXED) <= store->lowWatermarkFileNum &&
+                __atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED) <= store->lowWatermarkStorageSize) ||
+                !(victim = getVictim(store, NULL, NULL));
+            if (victim) {
+                evictFile(store, victim, NULL, notifyList, 0);
+            }
+        }
+        unlockAllShards(store);
+        DIE_ON_NZ(pthread_mutex_unlock(&(store->evictionMutex)));
+        // the evictor never reads files, so it has to free the files it evicted on its own
+        epochReclaim(store->epochs);
+    }
+    return true;
+}
+
+void stopBackgroundEviction(CacheStorage_t* store) {
+    /**
+     * @brief Makes `evictInBackground` return `false` instead of waiting for the storage to fill up again.
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(store->evictorMutex)));
+    store->evictorExit = true;
+    DIE_ON_NZ(pthread_cond_broadcast(&(store->evictorCond)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->evictorMutex)));
+}
+
+static void compactFile(CacheStorage_t* store, const char* pathname, const uint64_t pathHash, struct fdNode** notifyList) {
+    /**
+     * @brief Merges the small chunks of a file, if it's still in the storage.
+     * @details The file is written like any other write does: the merged chunks are compressed into a new \n
+     * version of the content, while readers keep reading the current one. Compressing bigger chunks doesn't \n
+     * always produce less data, so files might have to be evicted afterwards, like after a write.
+     *
+     * @param notifyList Output parameter: the clients that were waiting to lock one of the evicted files are appended to this list
+     */
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
+    FileNode_t* fptr = findFile(store, pathname, pathHash);
+    if (!fptr) {
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
+        return;
+    }
 
-    store->currFileNum += 1;
-    store->currStorageSize += filePtr->contentSize;
+    wordLock(&(fptr->ordering));
+    wordLock(&(fptr->mutex));
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
-    store->maxReachedFileNum = MAX(store->maxReachedFileNum, store->currFileNum);
-    store->maxReachedStorageSize = MAX(store->maxReachedStorageSize, store->currStorageSize);
+    while (fptr->isBeingWritten) {
+        wordCondWait(&(fptr->rwCond), &(fptr->mutex));
+    }
+    // from now on, the file can't be written to, evicted or removed until we're done, so its content won't change
+    fptr->isBeingWritten = true;
+    fptr->compactionQueued = false;
+    FileContent_t* content = fptr->content;
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
+
+    FileContent_t* merged = content ? compactContent(content, fptr->codec) : NULL;
+    FileContent_t* unused = merged; // the version that ends up being dropped
+    bool grown = false;
+
+    wordLock(&(fptr->mutex));
+    if (merged && merged->numChunks < content->numChunks) {
+        // same bytes, so the hot cache's image (if any) is still valid: `imageOf` is the only thing to update
+        __atomic_store_n(&(fptr->content), merged, __ATOMIC_RELEASE);
+        DIE_ON_NZ(pthread_mutex_lock(&(shard->hotMutex)));
+        if (fptr->imageOf == content) {
+            fptr->imageOf = merged;
+        }
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->hotMutex)));
+        fptr->smallChunksAfterCompaction = merged->numSmallChunks;
+        grown = merged->compressedSize > fptr->contentSize;
+        if (grown) {
+            __atomic_add_fetch(&(store->currStorageSize), merged->compressedSize - fptr->contentSize, __ATOMIC_RELAXED);
+        }
+        else {
+            __atomic_sub_fetch(&(store->currStorageSize), fptr->contentSize - merged->compressedSize, __ATOMIC_RELAXED);
+        }
+        fptr->contentSize = merged->compressedSize;
+        resizeEvictionOrder(store, shard, fptr);
+        unused = content; // readers of the old version might still hold references to it
+    }
+    else {
+        // nothing could be merged, or memory ran out: don't retry until more small chunks are appended
+        fptr->smallChunksAfterCompaction = content ? content->numSmallChunks : 0;
+    }
+    fptr->isBeingWritten = false;
+    wordCondBroadcast(&(fptr->rwCond));
+    wordUnlock(&(fptr->mutex));
+    notifyIdle(store);
+    releaseContent(unused);
+
+    if (grown) {
+        size_t currStorageSize = __atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED);
+        if (currStorageSize > store->maxStorageSize) {
+            makeRoom(store, 0, pathname, NULL, pathHash, NULL, notifyList, 0);
+        }
+        else {
+            updateMax(&(store->maxReachedStorageSize), currStorageSize);
+            wakeEvictor(store);
+        }
+    }
+}
+
+bool compactInBackground(CacheStorage_t* store, struct fdNode** notifyList) {
+    /**
+     * @brief Waits until a file is queued for compaction, then merges its small chunks.
+     *
+     * @param notifyList Output parameter: the clients that were waiting to lock one of the files evicted to make room \n
+     * for the merged chunks are appended to this list
+     *
+     * @return `false` if `stopBackgroundCompaction` has been called, `true` otherwise
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(store->compactorMutex)));
+    while (!store->compactorExit && !store->compactionHead) {
+        DIE_ON_NZ(pthread_cond_wait(&(store->compactorCond), &(store->compactorMutex)));
+    }
+    if (store->compactorExit) {
+        DIE_ON_NZ(pthread_mutex_unlock(&(store->compactorMutex)));
+        return false;
+    }
+    struct compactionRequest* request = store->compactionHead;
+    store->compactionHead = request->nextPtr;
+    if (!store->compactionHead) {
+        store->compactionTail = NULL;
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->compactorMutex)));
+
+    compactFile(store, request->pathname, request->pathHash, notifyList);
+    free(request->pathname);
+    free(request);
+    return true;
+}
+
+void stopBackgroundCompaction(CacheStorage_t* store) {
+    /**
+     * @brief Makes `compactInBackground` return `false` instead of waiting for files to compact.
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(store->compactorMutex)));
+    store->compactorExit = true;
+    DIE_ON_NZ(pthread_cond_broadcast(&(store->compactorCond)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(store->compactorMutex)));
 }
 
 
@@ -447,7 +1349,8 @@ int openFileHandler(CacheStorage_t* store, const char* pathname, int flags, stru
      * `EPERM` if the operation is forbidden: this happens if the requestor is trying to \n
      * open a nonexistent file without O_CREATE flag or if they're trying to open an extisting \n
      * file with O_CREATE flag \n
-     * `ENOMEM` memory for the ne file couldn't be allocated
+     * `ENOMEM` memory for the ne file couldn't be allocated \n
+     * `ENOSPC` the new file was rejected by the admission filter, or nothing could be evicted to make room for it
      *
      */
     if (!strlen(pathname) || requestor <= 0) {
@@ -461,35 +1364,36 @@ int openFileHandler(CacheStorage_t* store, const char* pathname, int flags, stru
     const bool create = IS_SET(O_CREATE, flags);
     const bool lock = IS_SET(O_LOCK, flags);
 
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
+    const uint64_t pathHash = hashPathname(pathname);
+    if (store->admissionSketch) {
+        // every use of a file starts with opening it: that's what determines how popular a file is
+        frequencySketchIncrement(store->admissionSketch, pathHash);
+    }
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
 
-    FileNode_t* fPtr = findFile(store, pathname);
+    FileNode_t* fPtr = findFile(store, pathname, pathHash);
     const bool alreadyExists = (fPtr != NULL);
 
     errno = 0; // we don't care about the error code of findFile here as we are managing both EINVAL and ENOENT directly
     if (alreadyExists == create) {
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
         errno = alreadyExists ? EPERM : ENOENT;
         return -1;
     }
 
     if (!alreadyExists) {
-        if (store->currFileNum == store->maxFileNum) {
-            FileNode_t* victim = getVictim(store, NULL);
-            logEvent(store->logBuffer, "EVICTED", victim->pathname, 0, requestor, 0);
-            destroyFile(store, victim, notifyList, true);
-
-            // reset ref count for LFU algorithm after evicting victims
-            FileNode_t* tmpPtr = store->hPtr;
-            while (tmpPtr) {
-                tmpPtr->refCount = 0;
-                tmpPtr = tmpPtr->nextPtr;
-            }
-
+        // evicting files requires the mutex of every shard: reserve a slot for the new file before linking it
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
+        if (!makeRoom(store, 1, NULL, pathname, pathHash, NULL, notifyList, requestor)) {
+            errno = ENOSPC;
+            return -1;
         }
-        fPtr = allocFile(pathname);
+
+        fPtr = allocFile(store, pathname, pathHash, store->defaultCodec);
         if (!fPtr) {
-            DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+            __atomic_sub_fetch(&(store->currFileNum), 1, __ATOMIC_RELAXED);
+            notifyIdle(store);
             return -1;
         }
         // file hasn't yet been linked to the storage; therefore we can modify it without
@@ -500,15 +1404,28 @@ int openFileHandler(CacheStorage_t* store, const char* pathname, int flags, stru
         }
 
         DIE_ON_NEG_ONE(pushFdToList(&(fPtr->openDescriptors), requestor));
+
+        DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
+        if (findFile(store, pathname, pathHash)) {
+            // another client created the file while we weren't holding the mutex: give the slot back
+            DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
+            __atomic_sub_fetch(&(store->currFileNum), 1, __ATOMIC_RELAXED);
+            notifyIdle(store);
+            popNodeFromFdQueue(&(fPtr->openDescriptors), requestor);
+            deallocFile(fPtr);
+            errno = EPERM;
+            return -1;
+        }
         logEvent(store->logBuffer, "OPEN", pathname, 0, requestor, 0);
 
         // nothing else will set `errno` from here on if everything is successful, so we can
         // omit error checking here as the return statement will check for errors
+        errno = 0;
         addFileToStore(store, fPtr);
     }
     else {
-        DIE_ON_NZ(pthread_mutex_lock(&(fPtr->ordering)));
-        DIE_ON_NZ(pthread_mutex_lock(&(fPtr->mutex)));
+        wordLock(&(fPtr->ordering));
+        wordLock(&(fPtr->mutex));
         if (lock) {
             if (!fPtr->lockedBy) {
                 fPtr->lockedBy = requestor;
@@ -519,25 +1436,50 @@ int openFileHandler(CacheStorage_t* store, const char* pathname, int flags, stru
         }
         if (!errnosave) {
             DIE_ON_NEG_ONE(pushFdToList(&(fPtr->openDescriptors), requestor));
+            fPtr->numOpens += 1;
         }
-        DIE_ON_NZ(pthread_mutex_unlock(&(fPtr->ordering)));
-        DIE_ON_NZ(pthread_mutex_unlock(&(fPtr->mutex)));
+        wordUnlock(&(fPtr->ordering));
+        wordUnlock(&(fPtr->mutex));
 
     }
     // add requestor to the list of clients that opened this file
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
     errno = errnosave;
     return errno ? -1 : 0;
 }
-int readFileHandler(CacheStorage_t* store, const char* pathname, void** buf, size_t* size, const int requestor) {
+int readFileHandler(CacheStorage_t* store, const char* pathname, SharedBuffer_t** buf, const int requestor) {
     /**
      * @brief Handles read-file requests from client.
      *
      * @param store A pointer to the storage containing the file
      * @param pathname Absolute pathname of the file
-     * @param buf Pointer to a buffer allocated on the heap which contains the read content. *Note*: the memory \n
-     * needs to be `free`d by the caller.
+     * @param buf Reference to a buffer holding the whole content of the file, and nothing else. *Note*: the \n
+     * caller needs to release it with `releaseSharedBuffer`.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     *
+     * `errno` values: see `readFileRangeHandler`
+     */
+    const char* data;
+    size_t size;
+    return readFileRangeHandler(store, pathname, 0, SIZE_MAX, buf, &data, &size, requestor);
+}
+
+int readFileRangeHandler(CacheStorage_t* store, const char* pathname, const size_t offset, const size_t len, SharedBuffer_t** buf, const char** data, size_t* size, const int requestor) {
+    /**
+     * @brief Handles read-range requests from client: reads up to `len` bytes of the file, starting at `offset`.
+     * @details Only the chunks covering the range are decompressed, unless the file is in the hot cache: then \n
+     * the range is served straight from its cached image, without decompressing or allocating anything. The same \n
+     * goes for ranges within a single raw chunk (e.g. whole files made of one), which are served from the chunk's data. \n
+     * Ranges reaching past the end of the file are cut short, so that `*size` might be smaller than `len` \n
+     * (or 0, if `offset` is past the end of the file).
+     *
+     * @param store A pointer to the storage containing the file
+     * @param pathname Absolute pathname of the file
+     * @param buf Reference to the buffer holding the read content, possibly along with the rest of the file. \n
+     * *Note*: the caller needs to release it with `releaseSharedBuffer`.
+     * @param data Start of the read content, inside `*buf`
      * @param size Amount of bytes read from the file.
      *
      * @return 0 on success, -1 on error (sets `errno`)
@@ -545,36 +1487,46 @@ int readFileHandler(CacheStorage_t* store, const char* pathname, void** buf, siz
      * `errno` values: \n
      * `ENOENT` file not found \n
      * `EACCES` file is locked or hasn't been opened by the requesting client \n
+     * `ENOMEM` memory for the read content couldn't be allocated \n
      * `EINVAL` invalid parameters
      */
     CHECK_INPUT(store, pathname, requestor);
     int errnosave = 0;
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
-
-    FileNode_t* fptr = findFile(store, pathname);
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    FileNode_t* fptr;
+
+    // the file is looked up without the shard's mutex: the epoch keeps it from being freed until we've
+    // locked it and found out whether it's still in the storage
+    epochEnter(store->epochs);
+    while ((fptr = findFile(store, pathname, pathHash))) {
+        // first critical section: takes a reference to the current version of the content, which writers
+        // replace rather than modify, and keeps the file from being locked or destroyed while we're reading it
+        wordLock(&(fptr->ordering));
+        wordLock(&(fptr->mutex));
+        if (!fptr->removed) {
+            break;
+        }
+        // a new file might have been created with the same pathname in the meantime
+        wordUnlock(&(fptr->ordering));
+        wordUnlock(&(fptr->mutex));
+    }
+    epochExit(store->epochs);
 
     // handle file not found
     if (!fptr) {
         errnosave = errno;
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
 
         logEvent(store->logBuffer, "READ", pathname, errnosave, requestor, 0);
         errno = errnosave;
         return -1;
     }
 
-    // first critical section: ensures no writers will access the file but grants access to other readers
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
-
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
-
-
     // handle file locked by another client or file hasn't been opened by the client
     if ((fptr->lockedBy && fptr->lockedBy != requestor) || !isFdInList(fptr->openDescriptors, requestor)) {
         errnosave = EACCES;
-        DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-        DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+        wordUnlock(&(fptr->ordering));
+        wordUnlock(&(fptr->mutex));
 
         logEvent(store->logBuffer, "READ", pathname, errnosave, requestor, 0);
 
@@ -582,39 +1534,61 @@ int readFileHandler(CacheStorage_t* store, const char* pathname, void** buf, siz
         return -1;
     }
 
-    while (fptr->isBeingWritten) {
-        DIE_ON_NZ(pthread_cond_wait(&(fptr->rwCond), &(fptr->mutex)));
-    }
-
     fptr->activeReaders += 1;
+    FileContent_t* content = fptr->content;
+    acquireContent(content);
+
+    const size_t start = MIN(offset, fptr->uncompressedSize);
+    *size = MIN(len, fptr->uncompressedSize - start);
+    // files that keep being read whole without changing are worth keeping decompressed
+    const bool cacheImage = store->hotCacheShardBudget && *size == fptr->uncompressedSize && ++(fptr->readsSinceWrite) >= HOT_CACHE_MIN_READS;
 
-    UPDATE_CACHE_BITS(fptr);
+    UPDATE_CACHE_BITS(store, fptr);
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
 
     // actual read operation
-    *buf = RLEdecompress(fptr->content, fptr->contentSize, fptr->uncompressedSize, 0);
-    if (*buf == NULL) {
+    if ((*buf = shareRawRange(content, start, *size, data))) {
+        // the range lies within a single raw chunk: its data already is the read content
+    }
+    else if (store->hotCacheShardBudget && (*buf = getHotImage(store, shard, fptr, content))) {
+        *data = (*buf)->data + start;
+    }
+    else if (!(*buf = allocSharedBuffer(*size)) || decompressContentRange(content, start, *size, (*buf)->data) == -1) {
+        releaseSharedBuffer(*buf);
+        *buf = NULL;
+        *data = NULL;
+        *size = 0;
         errnosave = ENOMEM;
     }
-    *size = fptr->uncompressedSize;
+    else {
+        *data = (*buf)->data;
+        if (cacheImage) {
+            cacheHotImage(store, shard, fptr, content, *buf);
+        }
+    }
+    releaseContent(content);
     // end actual read operation
 
-    logEvent(store->logBuffer, "READ", pathname, errnosave, requestor, (errnosave ? 0 : fptr->contentSize));
+    logEvent(store->logBuffer, "READ", pathname, errnosave, requestor, *size);
 
-    // second critical section: we're done reading so, if no more readers are active, we can let a writer in
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    // second critical section: we're done reading so, if no more readers are active, the file can be locked or destroyed
+    wordLock(&(fptr->mutex));
 
     fptr->activeReaders -= 1;
 
     fptr->canDoFirstWrite = 0; // last operation on this file isn't `openFile` with `O_LOCK|O_CREATE` anymore because a successful operation was done on it
 
-    if (!fptr->activeReaders) {
-        DIE_ON_NZ(pthread_cond_signal(&(fptr->rwCond)));
+    const bool idle = !fptr->activeReaders;
+    if (idle) {
+        wordCondBroadcast(&(fptr->rwCond));
     }
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    wordUnlock(&(fptr->mutex));
+    if (idle) {
+        notifyIdle(store);
+    }
 
     errno = errnosave;
 
@@ -633,8 +1607,10 @@ int readNFilesHandler(CacheStorage_t* store, const long upperLimit, void** buf,
      *
      * @return the number of read files on success, -1 on error (sets `errno`)
      *
-     * This function effectively takes a "snapshot" of the current state of `store`, and all reads are \n
-     * done in mutual exclusion to prevent changes to the storages while the function is running.
+     * Files are read in the order they were inserted in the storage, as if it weren't sharded: the file lists \n
+     * of the shards, each in insertion order, are merged by `insertionSeq`. The shards are only locked while \n
+     * the files are picked and a reference to their current content is taken; the contents are decompressed \n
+     * once the shards are unlocked.
      *
      * `errno` values: \n
      * `ENOMEM` memory for the response couldn't be allocated \n
@@ -657,41 +1633,80 @@ int readNFilesHandler(CacheStorage_t* store, const long upperLimit, void** buf,
         return -1;
     }
 
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
-    FileNode_t* currPtr = store->hPtr;
+    // files of a shard can't be deleted while we hold its mutex
+    lockAllShards(store);
+
+    size_t numFiles = 0;
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        numFiles += fileIndexSize(store->shards[i].dictStore);
+    }
+    if (upperLimit > 0 && (size_t)upperLimit < numFiles) {
+        numFiles = upperLimit;
+    }
+    // the read files' contents, with the offset in `ret` they're going to be decompressed to
+    struct pinnedContent {
+        FileContent_t* content;
+        size_t offset;
+    }*pinned = malloc((numFiles ? numFiles : 1) * sizeof(*pinned));
+    if (!pinned) {
+        errnosave = ENOMEM;
+        numFiles = 0;
+    }
+
+    FileNode_t* cursors[STORE_SHARDS]; // next file of each shard to be read
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        cursors[i] = store->shards[i].hPtr;
+    }
 
-    while (currPtr && (readCount != upperLimit || upperLimit <= 0)) {
-        size_t retNewSize = retCurrSize + currPtr->uncompressedSize + strlen(currPtr->pathname) + 2 * METADATA_SIZE;
+    while ((size_t)readCount < numFiles) {
+        // the next file in insertion order is the first of one of the shards
+        size_t next = STORE_SHARDS;
+        for (size_t i = 0; i < STORE_SHARDS; i++) {
+            if (cursors[i] && (next == STORE_SHARDS || cursors[i]->insertionSeq < cursors[next]->insertionSeq)) {
+                next = i;
+            }
+        }
+        FileNode_t* currPtr = cursors[next];
+        cursors[next] = currPtr->nextPtr;
+
+        // take a reference to the current version of the content: writes in progress publish a new one
+        wordLock(&(currPtr->ordering));
+        wordLock(&(currPtr->mutex));
+        FileContent_t* content = currPtr->content;
+        acquireContent(content);
+        const size_t contentSize = currPtr->uncompressedSize;
+        wordUnlock(&(currPtr->ordering));
+        wordUnlock(&(currPtr->mutex));
+
+        size_t retNewSize = retCurrSize + contentSize + strlen(currPtr->pathname) + 2 * METADATA_SIZE;
         if (retNewSize > retMaxSize) {
             void* tmp = realloc(ret, 2 * retNewSize);
             if (!tmp) {
+                releaseContent(content);
                 errnosave = ENOMEM;
-                free(ret);
-                goto cleanup;
+                break;
             }
             ret = tmp;
-            retMaxSize = 2 * retMaxSize;
+            retMaxSize = 2 * retNewSize;
         }
         sprintf(
             ret + retCurrSize,
             "%010ld%s%010ld",
-            strlen(currPtr->pathname), currPtr->pathname, currPtr->uncompressedSize
+            strlen(currPtr->pathname), currPtr->pathname, contentSize
         );
-        char* uncompressedContent = RLEdecompress(currPtr->content, currPtr->contentSize, currPtr->uncompressedSize, 0);
-        if (uncompressedContent == NULL) {
-            errnosave = ENOMEM;
-            break;
-        }
-        memcpy((ret + retNewSize - (currPtr->uncompressedSize)), uncompressedContent, currPtr->uncompressedSize);
+        pinned[readCount].content = content;
+        pinned[readCount].offset = retNewSize - contentSize;
         retCurrSize = retNewSize;
-        free(uncompressedContent);
-
-        currPtr = currPtr->nextPtr;
         readCount += 1;
     }
 
-cleanup:
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    unlockAllShards(store);
+
+    for (int i = 0; i < readCount; i++) {
+        decompressContentTo(pinned[i].content, ret + pinned[i].offset);
+        releaseContent(pinned[i].content);
+    }
+    free(pinned);
 
     *buf = ret;
     *size = retCurrSize;
@@ -721,13 +1736,14 @@ int writeToFileHandler(CacheStorage_t* store, const char* pathname, const char*
 
     int errnosave = 0;
 
-    // gain mutual exclusion over the whole store because files might end up being deleted
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
 
-    FileNode_t* fptr = findFile(store, pathname);
+    FileNode_t* fptr = findFile(store, pathname, pathHash);
 
     if (!fptr) {
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
         errnosave = errno;
         logEvent(store->logBuffer, "WRITE", pathname, errnosave, requestor, 0);
         errno = errnosave;
@@ -735,94 +1751,98 @@ int writeToFileHandler(CacheStorage_t* store, const char* pathname, const char*
     }
 
     // first critical section: ensures no writers or readers will access the file
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    wordLock(&(fptr->ordering));
+    wordLock(&(fptr->mutex));
 
-    // this can't be true at this time because it would mean two writers both have mutex over the store
-    assert(!fptr->isBeingWritten);
+    // the file can't be deleted while we're holding its mutexes, and it won't be deleted while it's
+    // being written: the shard doesn't need to be locked during the (possibly long) write
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
     if ((fptr->lockedBy && fptr->lockedBy != requestor) || !isFdInList(fptr->openDescriptors, requestor)) {
         errnosave = EACCES;
-        DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-        DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        wordUnlock(&(fptr->ordering));
+        wordUnlock(&(fptr->mutex));
         logEvent(store->logBuffer, "WRITE", pathname, errnosave, requestor, 0);
         errno = errnosave;
         return -1;
     }
 
-    while (fptr->activeReaders > 0) {
-        DIE_ON_NZ(pthread_cond_wait(&(fptr->rwCond), &(fptr->mutex)));
+    // readers can keep reading the current content while the new one is built
+    while (fptr->isBeingWritten) {
+        wordCondWait(&(fptr->rwCond), &(fptr->mutex));
     }
 
     fptr->isBeingWritten = true;
-    UPDATE_CACHE_BITS(fptr);
-
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
-
-    // actual write operation
-
-    // get the decompressed content and also allocate `newContentLen` extra bytes after it
-    char* decompressedContent = RLEdecompress(fptr->content, fptr->contentSize, fptr->uncompressedSize, newContentLen);
-
-    // now append new content to the buffer allocated by `RLEdecompress`
-    memcpy(decompressedContent + fptr->uncompressedSize, newContent, newContentLen);
-
-    // compress the file contaning the new content and find out what the final size is
-    size_t newCompressedSize = 0;
-    char* newCompressedContent = RLEcompress(decompressedContent, fptr->uncompressedSize + newContentLen, &newCompressedSize);
-    free(decompressedContent);
+    UPDATE_CACHE_BITS(store, fptr);
+    const bool wasEmpty = (fptr->uncompressedSize == 0); // the file is receiving its first content: it's still subject to admission
+    // only writers replace the content, and we're the only one: it stays the current version until we publish ours
+    FileContent_t* content = fptr->content;
+
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
+
+    // actual write operation: only the new bytes are compressed, into chunks of their own that are
+    // appended to the current ones in a new version of the content; readers can keep reading the
+    // current version in the meantime
+    FileContent_t* newVersion = NULL;
+    if (newContentLen && !(newVersion = appendToContent(content, newContent, newContentLen, fptr->codec))) {
+        errnosave = ENOMEM;
+    }
+    FileContent_t* unused = newVersion; // the version that ends up being dropped
 
-    if (newCompressedSize > store->maxStorageSize) {
+    // second critical section: publish the new version, then wake up any pending writers; readers of the
+    // old version keep their reference to it, which is freed once the last of them is done
+    bool needsCompaction = false;
+    wordLock(&(fptr->mutex));
+    if (errnosave) {
+        // nothing to commit
+    }
+    else if (newVersion && newVersion->compressedSize > store->maxStorageSize) {
         // file cannot be stored because it is too large
         errnosave = E2BIG;
-        free(newCompressedContent);
-        logEvent(store->logBuffer, "WRITE", pathname, errnosave, requestor, 0);
-        goto cleanup;
     }
-    while (store->currStorageSize - fptr->contentSize + newCompressedSize > store->maxStorageSize) {
-        // we pass `fptr` as the second param to `getVictim` to prevent the file we're writing to from being chosen as the victim
-        FileNode_t* victim = getVictim(store, fptr);
-        assert(victim);
-        struct fdNode* tmpList = NULL; // will hold a list of fd's that were waiting on this file before it got deleted
-        destroyFile(store, victim, &tmpList, false); // unlink the file from storage but don't free the struct itself
-
-        // build a list of evicted files
-        victim->nextPtr = *evictedList;
-        *evictedList = victim;
-
-        // make a single list with all the clients that need to be notified that a file they were blocked on doesn't exist (anymore)
-        concatenateFdLists(notifyList, tmpList);
-        logEvent(store->logBuffer, "EVICTED", victim->pathname, 0, requestor, 0);
+    else {
+        if (newVersion) {
+            // the storage might temporarily exceed its capacity: this is fixed right below, once the file isn't
+            // being written anymore (files that are being written aren't evicted)
+            __atomic_add_fetch(&(store->currStorageSize), newVersion->compressedSize - fptr->contentSize, __ATOMIC_RELAXED);
+
+            // update file
+            __atomic_store_n(&(fptr->content), newVersion, __ATOMIC_RELEASE);
+            fptr->uncompressedSize = newVersion->uncompressedSize;
+            fptr->contentSize = newVersion->compressedSize;
+            resizeEvictionOrder(store, shard, fptr);
+            fptr->readsSinceWrite = 0;
+            invalidateHotImage(shard, fptr);
+            needsCompaction = !fptr->compactionQueued && newVersion->numSmallChunks >= fptr->smallChunksAfterCompaction + COMPACTION_THRESHOLD;
+            fptr->compactionQueued |= needsCompaction;
+            unused = content; // readers of the old version might still hold references to it
+        }
+        fptr->canDoFirstWrite = 0; // last operation on this file isn't `openFile` with `O_LOCK|O_CREATE` anymore because a successful operation was done on it
     }
+    fptr->isBeingWritten = false;
+    wordCondBroadcast(&(fptr->rwCond));
+    wordUnlock(&(fptr->mutex));
+    notifyIdle(store);
+    releaseContent(unused);
 
-    // reset ref count for LFU algorithm after evicting victims
-    FileNode_t* tmpPtr = store->hPtr;
-    while (tmpPtr) {
-        tmpPtr->refCount = 0;
-        tmpPtr = tmpPtr->nextPtr;
+    if (needsCompaction) {
+        queueCompaction(store, pathname, pathHash);
     }
 
-    store->currStorageSize = store->currStorageSize - fptr->contentSize + newCompressedSize;
-    store->maxReachedStorageSize = MAX(store->maxReachedStorageSize, store->currStorageSize);
-
-    // update file
-    free(fptr->content);
-    fptr->content = newCompressedContent;
-    fptr->uncompressedSize = fptr->uncompressedSize + newContentLen;
-    fptr->contentSize = newCompressedSize;
-
+    if (!errnosave) {
+        size_t currStorageSize = __atomic_load_n(&(store->currStorageSize), __ATOMIC_RELAXED);
+        if (currStorageSize > store->maxStorageSize) {
+            // the file we just wrote to is spared from being chosen as the victim; it's passed by pathname, as it
+            // might be removed (and its memory reused) as soon as we stop holding its mutexes
+            makeRoom(store, 0, pathname, (wasEmpty ? pathname : NULL), pathHash, evictedList, notifyList, requestor);
+        }
+        else {
+            updateMax(&(store->maxReachedStorageSize), currStorageSize);
+            wakeEvictor(store);
+        }
+    }
     logEvent(store->logBuffer, "WRITE", pathname, errnosave, requestor, (errnosave ? 0 : newContentLen));
-    fptr->canDoFirstWrite = 0; // last operation on this file isn't `openFile` with `O_LOCK|O_CREATE` anymore because a successful operation was done on it
-
-cleanup:
-    // second critical section: we're done writing, we can wake up any pending readers and also release the lock over the store
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
-    fptr->isBeingWritten = false;
-    DIE_ON_NZ(pthread_cond_broadcast(&(fptr->rwCond)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
 
     errno = errnosave;
     return errno ? -1 : 0;
@@ -846,53 +1866,56 @@ int lockFileHandler(CacheStorage_t* store, const char* pathname, const int reque
      * `ENOENT` file not found \n
      * `EINVAL` invalid parameters
      */
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
     int errnosave = 0;
 
-    FileNode_t* fptr = findFile(store, pathname);
+    FileNode_t* fptr = findFile(store, pathname, pathHash);
 
     if (!fptr) {
         errnosave = errno;
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
         logEvent(store->logBuffer, "LOCK", pathname, errnosave, requestor, 0);
         errno = errnosave;
         return -1;
     }
 
     // first critical section: ensures no writers or readers will access the file
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    wordLock(&(fptr->ordering));
+    wordLock(&(fptr->mutex));
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
     while (fptr->activeReaders > 0 || fptr->isBeingWritten) {
-        DIE_ON_NZ(pthread_cond_wait(&(fptr->rwCond), &(fptr->mutex)));
+        wordCondWait(&(fptr->rwCond), &(fptr->mutex));
     }
 
     if (fptr->lockedBy && fptr->lockedBy != requestor) {
         // lock cannot be gained at the moment: place requestor on waiting queue and return
         DIE_ON_NEG_ONE(pushFdToList(&(fptr->pendingLocks_hPtr), requestor));
-        DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
-        DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
+        wordUnlock(&(fptr->mutex));
+        wordUnlock(&(fptr->ordering));
 
         logEvent(store->logBuffer, "LOCK", pathname, -2, requestor, 0);
         return -2;
     }
 
     fptr->isBeingWritten = true;
-    UPDATE_CACHE_BITS(fptr);
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
-
     fptr->lockedBy = requestor;
+    UPDATE_CACHE_BITS(store, fptr);
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
+
     logEvent(store->logBuffer, "LOCK", pathname, 0, requestor, 0);
 
     // second critical section: we're done writing, we can wake up any pending readers and also release the lock over the store
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    wordLock(&(fptr->mutex));
     fptr->isBeingWritten = false;
     fptr->canDoFirstWrite = 0; // last operation on this file isn't `openFile` with `O_LOCK|O_CREATE` anymore because a successful operation was done on it
-    DIE_ON_NZ(pthread_cond_broadcast(&(fptr->rwCond))); // wake up pending readers or writers
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    wordCondBroadcast(&(fptr->rwCond)); // wake up pending readers or writers
+    wordUnlock(&(fptr->mutex));
+    notifyIdle(store);
 
     return 0;
 }
@@ -917,42 +1940,43 @@ int clientExitHandler(CacheStorage_t* store, struct fdNode** notifyList, const i
         return -1;
     }
 
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
-
-    FileNode_t* currPtr = store->hPtr;
-    while (currPtr) {
-        DIE_ON_NZ(pthread_mutex_lock(&(currPtr->ordering)));
-        DIE_ON_NZ(pthread_mutex_lock(&(currPtr->mutex)));
+    for (size_t i = 0; i < STORE_SHARDS; i++) {
+        StoreShard_t* shard = &(store->shards[i]);
+        DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
 
-        while (currPtr->activeReaders > 0 || currPtr->isBeingWritten) {
-            DIE_ON_NZ(pthread_cond_wait(&(currPtr->rwCond), &(currPtr->mutex)));
-        }
-
-        if (currPtr->lockedBy == requestor) {
-            // will be 0 if no clients are waiting to lock this file; otherwise it'll be the fd of the
-            // first client that is stuck waiting to lock
-            int newLock = popNodeFromFdQueue(&(currPtr->pendingLocks_hPtr), -1);
+        FileNode_t* currPtr = shard->hPtr;
+        while (currPtr) {
+            // no need to wait for the operations in progress: only the lock and the lists of clients change, and
+            // no other client can be using a file the exiting client had locked but the compactor, which doesn't care
+            wordLock(&(currPtr->ordering));
+            wordLock(&(currPtr->mutex));
+
+            if (currPtr->lockedBy == requestor) {
+                // will be 0 if no clients are waiting to lock this file; otherwise it'll be the fd of the
+                // first client that is stuck waiting to lock
+                int newLock = popNodeFromFdQueue(&(currPtr->pendingLocks_hPtr), -1);
+
+                // communicate new lock's fd back to caller
+                if (newLock > 0) {
+                    pushFdToList(notifyList, newLock);
+                }
 
-            // communicate new lock's fd back to caller
-            if (newLock > 0) {
-                pushFdToList(notifyList, newLock);
+                currPtr->lockedBy = newLock;
             }
 
-            currPtr->lockedBy = newLock;
-        }
+            // if client was blocked on a file waiting to lock it, remove it from the waiting list
+            popNodeFromFdQueue(&(currPtr->pendingLocks_hPtr), requestor);
+            // remove client from list of fd's who opened this file
+            popNodeFromFdQueue(&(currPtr->openDescriptors), requestor);
 
-        // if client was blocked on a file waiting to lock it, remove it from the waiting list
-        popNodeFromFdQueue(&(currPtr->pendingLocks_hPtr), requestor);
-        // remove client from list of fd's who opened this file
-        popNodeFromFdQueue(&(currPtr->openDescriptors), requestor);
+            wordUnlock(&(currPtr->ordering));
+            wordUnlock(&(currPtr->mutex));
 
-        DIE_ON_NZ(pthread_mutex_unlock(&(currPtr->ordering)));
-        DIE_ON_NZ(pthread_mutex_unlock(&(currPtr->mutex)));
+            currPtr = currPtr->nextPtr;
+        }
 
-        currPtr = currPtr->nextPtr;
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
     }
-
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
     return 0;
 }
 
@@ -975,26 +1999,28 @@ int unlockFileHandler(CacheStorage_t* store, const char* pathname, int* newLockF
      */
     CHECK_INPUT(store, pathname, requestor);
     int errnosave = 0;
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
 
-    FileNode_t* fptr = findFile(store, pathname);
+    FileNode_t* fptr = findFile(store, pathname, pathHash);
     if (!fptr) {
         errnosave = errno;
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
         logEvent(store->logBuffer, "UNLOCK", pathname, errnosave, requestor, 0);
         errno = errnosave;
         return -1;
     }
 
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    wordLock(&(fptr->ordering));
+    wordLock(&(fptr->mutex));
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
     while (fptr->activeReaders > 0 || fptr->isBeingWritten) {
-        DIE_ON_NZ(pthread_cond_wait(&(fptr->rwCond), &(fptr->mutex)));
+        wordCondWait(&(fptr->rwCond), &(fptr->mutex));
     }
-    UPDATE_CACHE_BITS(fptr);
+    UPDATE_CACHE_BITS(store, fptr);
 
     if (fptr->lockedBy == requestor) {
         // will be 0 if no clients are waiting to lock this file; otherwise it'll be the fd of the first client
@@ -1012,9 +2038,9 @@ int unlockFileHandler(CacheStorage_t* store, const char* pathname, int* newLockF
     }
     logEvent(store->logBuffer, "UNLOCK", pathname, errnosave, requestor, 0);
 
-    DIE_ON_NZ(pthread_cond_broadcast(&(fptr->rwCond))); // wake up pending readers or writers
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    wordCondBroadcast(&(fptr->rwCond)); // wake up pending readers or writers
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
 
     errno = errnosave;
     return errno ? -1 : 0;
@@ -1035,44 +2061,40 @@ int closeFileHandler(CacheStorage_t* store, const char* pathname, const int requ
      * `EINVAL` invalid parameters
      */
     CHECK_INPUT(store, pathname, requestor);
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
 
-    FileNode_t* fptr = findFile(store, pathname);
+    FileNode_t* fptr = findFile(store, pathname, pathHash);
 
     if (!fptr) {
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
         return -1;
     }
 
-    // first critical section: ensures no writers or readers will access the file
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    // critical section: ensures no writers or readers will access the file
+    wordLock(&(fptr->ordering));
+    wordLock(&(fptr->mutex));
 
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
     while (fptr->activeReaders > 0 || fptr->isBeingWritten) {
-        DIE_ON_NZ(pthread_cond_wait(&(fptr->rwCond), &(fptr->mutex)));
+        wordCondWait(&(fptr->rwCond), &(fptr->mutex));
     }
 
-    fptr->isBeingWritten = true;
-    UPDATE_CACHE_BITS(fptr);
-
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    UPDATE_CACHE_BITS(store, fptr);
 
     // actual close operation
     // remove requestor from list of fd's that opened this file
     popNodeFromFdQueue(&(fptr->openDescriptors), requestor);
-    logEvent(store->logBuffer, "CLOSE", pathname, 0, requestor, 0);
+    fptr->canDoFirstWrite = 0; // last operation on this file isn't `openFile` with `O_LOCK|O_CREATE` anymore because a successful operation was done on it
     // end actual close operation
 
-    // second critical section: we're done writing, we can wake up any pending readers and also release the lock over the store
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
-    fptr->isBeingWritten = false;
-    fptr->canDoFirstWrite = 0; // last operation on this file isn't `openFile` with `O_LOCK|O_CREATE` anymore because a successful operation was done on it
-    DIE_ON_NZ(pthread_cond_broadcast(&(fptr->rwCond))); // wake up pending readers or writers
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    wordCondBroadcast(&(fptr->rwCond)); // wake up pending readers or writers
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    logEvent(store->logBuffer, "CLOSE", pathname, 0, requestor, 0);
 
     return 0;
 }
@@ -1094,21 +2116,51 @@ int removeFileHandler(CacheStorage_t* store, const char* pathname, struct fdNode
      */
     CHECK_INPUT(store, pathname, requestor);
 
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
-
-    errno = 0;
-    FileNode_t* fptr = findFile(store, pathname);
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
+
+    FileNode_t* fptr;
+    while (true) {
+        errno = 0;
+        fptr = findFile(store, pathname, pathHash);
+        if (!fptr) {
+            errno = ENOENT;
+            DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
+            return -1;
+        }
 
-    if (!fptr || fptr->lockedBy != requestor) {
-        errno = !fptr ? ENOENT : EACCES;
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
-        return -1;
+        wordLock(&(fptr->ordering));
+        wordLock(&(fptr->mutex));
+        if (fptr->lockedBy != requestor) {
+            wordUnlock(&(fptr->ordering));
+            wordUnlock(&(fptr->mutex));
+            DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
+            errno = EACCES;
+            return -1;
+        }
+        if (!fptr->activeReaders && !fptr->isBeingWritten) {
+            break;
+        }
+        // a read, write or compaction is in progress, and a write can take long: wait for it without holding the shard,
+        // or the file's `ordering`, which other threads might wait for while holding the shard. Only the compactor can
+        // start using a file locked by the requestor meanwhile; the epoch keeps the file from being freed if it's
+        // evicted as soon as it's idle, and it's looked up again afterwards
+        epochEnter(store->epochs);
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
+        wordUnlock(&(fptr->ordering));
+        while (fptr->activeReaders > 0 || fptr->isBeingWritten) {
+            wordCondWait(&(fptr->rwCond), &(fptr->mutex));
+        }
+        wordUnlock(&(fptr->mutex));
+        epochExit(store->epochs);
+        DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
     }
 
     logEvent(store->logBuffer, "REMOVE", pathname, 0, requestor, 0);
-    destroyFile(store, fptr, notifyList, true);
+    destroyFile(store, fptr, notifyList, true, false);
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
     return 0;
 
@@ -1125,24 +2177,26 @@ bool testFirstWrite(CacheStorage_t* store, const char* pathname, const int reque
     }
     bool ret;
 
-    DIE_ON_NZ(pthread_mutex_lock(&(store->mutex)));
+    const uint64_t pathHash = hashPathname(pathname);
+    StoreShard_t* shard = getShard(store, pathHash);
+    DIE_ON_NZ(pthread_mutex_lock(&(shard->mutex)));
 
-    FileNode_t* fptr = findFile(store, pathname);
+    FileNode_t* fptr = findFile(store, pathname, pathHash);
 
     if (!fptr) {
-        DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+        DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
         return false;
     }
 
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_lock(&(fptr->mutex)));
+    wordLock(&(fptr->ordering));
+    wordLock(&(fptr->mutex));
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(store->mutex)));
+    DIE_ON_NZ(pthread_mutex_unlock(&(shard->mutex)));
 
     ret = (fptr->canDoFirstWrite == requestor);
 
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->ordering)));
-    DIE_ON_NZ(pthread_mutex_unlock(&(fptr->mutex)));
+    wordUnlock(&(fptr->ordering));
+    wordUnlock(&(fptr->mutex));
 
     return ret;
 }
@@ -0,0 +1,113 @@
+/*! \file */
+/**
+ * Count-min sketch estimating how many times each key has been seen recently, in a fixed amount of memory.
+ *
+ * Each of the `SKETCH_DEPTH` rows holds one small counter per column; a key is mapped to a column of every row
+ * and its estimate is the smallest of those counters, so collisions can only make a key look more popular than
+ * it is. Counters saturate at `SKETCH_MAX_COUNT` and, once `SKETCH_SAMPLE_FACTOR` increments per column have been
+ * made, all of them are halved, so that the sketch reflects recent popularity rather than all-time popularity.
+ *
+ * All operations are lock-free and can be called concurrently; an increment racing with the halving might be lost,
+ * which only makes the estimates slightly less accurate.
+ */
+
+#include "../include/frequencySketch.h"
+#include <errno.h>
+#include <stdbool.h>
+
+#define SKETCH_DEPTH 4
+#define SKETCH_SAMPLE_FACTOR 10
+#define SKETCH_MIN_WIDTH 64
+#define SKETCH_MAX_WIDTH ((size_t)1 << 22) /**< Caps the memory used by the sketch to 16 MiB */
+
+struct _frequencySketch {
+    uint8_t* counters; /**< `SKETCH_DEPTH` rows of `width` counters */
+    size_t width; /**< A power of two */
+    size_t sampleSize; /**< Number of increments after which the counters are halved */
+    size_t additions; /**< Only accessed atomically; increments since the counters were last halved */
+};
+
+static size_t _column(const FrequencySketch* sketch, uint64_t hash, size_t row) {
+    // double hashing: the two halves of the hash give a different column for every row
+    const uint64_t h1 = hash & 0xFFFFFFFF, h2 = (hash >> 32) | 1;
+    return row * sketch->width + ((h1 + row * h2) & (sketch->width - 1));
+}
+
+static void _halve(FrequencySketch* sketch) {
+    for (size_t i = 0; i < SKETCH_DEPTH * sketch->width; i++) {
+        uint8_t count = __atomic_load_n(&(sketch->counters[i]), __ATOMIC_RELAXED);
+        if (count) {
+            __atomic_store_n(&(sketch->counters[i]), count / 2, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+FrequencySketch* allocFrequencySketch(size_t expectedKeys) {
+    /**
+     * @brief Initializes and returns a new sketch with all counters set to 0.
+     * @param expectedKeys Number of distinct keys expected to be popular at the same time (e.g. the capacity of a cache)
+     * @return A pointer to the new sketch, or NULL on error (sets `errno`)
+     *
+     * Upon error, `errno` will have one of the following values:\n
+     * `ENOMEM`: memory for the sketch couldn't be allocated
+     */
+    FrequencySketch* sketch = calloc(1, sizeof(*sketch));
+    if (!sketch) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sketch->width = SKETCH_MIN_WIDTH;
+    while (sketch->width < expectedKeys && sketch->width < SKETCH_MAX_WIDTH) {
+        sketch->width <<= 1;
+    }
+    sketch->sampleSize = SKETCH_SAMPLE_FACTOR * sketch->width;
+    if (!(sketch->counters = calloc(SKETCH_DEPTH * sketch->width, sizeof(*(sketch->counters))))) {
+        free(sketch);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return sketch;
+}
+
+int destroyFrequencySketch(FrequencySketch* sketch) {
+    if (!sketch) {
+        errno = EINVAL;
+        return -1;
+    }
+    free(sketch->counters);
+    free(sketch);
+    return 0;
+}
+
+void frequencySketchIncrement(FrequencySketch* sketch, uint64_t hash) {
+    /**
+     * @brief Records an occurrence of the key with the given hash.
+     */
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        uint8_t* counter = &(sketch->counters[_column(sketch, hash, row)]);
+        uint8_t count = __atomic_load_n(counter, __ATOMIC_RELAXED);
+        while (count < SKETCH_MAX_COUNT &&
+            !__atomic_compare_exchange_n(counter, &count, count + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+
+    // only the thread that reaches the sample size halves the counters
+    if (__atomic_add_fetch(&(sketch->additions), 1, __ATOMIC_RELAXED) == sketch->sampleSize) {
+        _halve(sketch);
+        __atomic_store_n(&(sketch->additions), 0, __ATOMIC_RELAXED);
+    }
+}
+
+unsigned frequencySketchEstimate(const FrequencySketch* sketch, uint64_t hash) {
+    /**
+     * @brief Returns an estimate (never lower than the actual value, up to `SKETCH_MAX_COUNT`) of the number \n
+     * of times the key with the given hash has been recently seen.
+     */
+    unsigned estimate = SKETCH_MAX_COUNT;
+    for (size_t row = 0; row < SKETCH_DEPTH; row++) {
+        uint8_t count = __atomic_load_n(&(sketch->counters[_column(sketch, hash, row)]), __ATOMIC_RELAXED);
+        if (count < estimate) {
+            estimate = count;
+        }
+    }
+    return estimate;
+}
@@ -0,0 +1,185 @@
+/*! \file */
+/**
+ * Fast LZ77 byte codec, producing blocks in the LZ4 block format.
+ *
+ * A block is a sequence of (literals, match) pairs. Each pair starts with a token byte whose high nibble is the
+ * number of literals and whose low nibble is the match length minus `LZ_MIN_MATCH`; a nibble of 15 is followed by
+ * bytes of 255 and a final byte smaller than 255, all added to it. The literals come next, then the distance of
+ * the match as a 2 bytes little endian number. The last pair has no match, and the last `LZ_LAST_LITERALS` bytes
+ * of the input are always literals.
+ *
+ * Matches are found with a single-entry hash table of the positions of 4 bytes sequences, so compression runs
+ * in linear time; the search skips ahead faster and faster through data where it can't find any matches.
+ */
+
+#include "../include/lzCompression.h"
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12 /**< Matches can't start in the last `LZ_MATCH_LIMIT` bytes of the input */
+#define LZ_MAX_DISTANCE 65535
+#define LZ_HASH_LOG 12
+#define LZ_SKIP_TRIGGER 6 /**< The search step grows by one every `1 << LZ_SKIP_TRIGGER` bytes without a match */
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+static inline size_t writeLength(unsigned char* dest, size_t len) {
+    // writes the part of a length that doesn't fit in its nibble
+    size_t written = 0;
+    for (; len >= 255; len -= 255) {
+        dest[written++] = 255;
+    }
+    dest[written++] = (unsigned char)len;
+    return written;
+}
+
+static size_t writeSequence(unsigned char* dest, const unsigned char* literals, size_t numLiterals, size_t distance, size_t matchLen) {
+    // `matchLen` is 0 for the last sequence, which has no match
+    size_t op = 0;
+    const size_t matchCode = matchLen ? matchLen - LZ_MIN_MATCH : 0;
+    unsigned char* token = dest + op++;
+    *token = (unsigned char)(((numLiterals < 15 ? numLiterals : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (numLiterals >= 15) {
+        op += writeLength(dest + op, numLiterals - 15);
+    }
+    memcpy(dest + op, literals, numLiterals);
+    op += numLiterals;
+    if (matchLen) {
+        dest[op++] = (unsigned char)(distance & 0xFF);
+        dest[op++] = (unsigned char)(distance >> 8);
+        if (matchCode >= 15) {
+            op += writeLength(dest + op, matchCode - 15);
+        }
+    }
+    return op;
+}
+
+size_t LZcompress(const char* src, size_t size, char* dest) {
+    /**
+     * @brief Compresses `size` bytes of `src` into `dest`, which must be at least `LZ_MAX_COMPRESSED_SIZE(size)` bytes long.
+     *
+     * @return The size of the compressed data
+     */
+    const unsigned char* in = (const unsigned char*)src;
+    unsigned char* out = (unsigned char*)dest;
+    size_t ip = 0, anchor = 0, op = 0;
+
+    if (size > LZ_MATCH_LIMIT) {
+        uint32_t table[1 << LZ_HASH_LOG] = { 0 }; // positions of the last sequence seen with each hash
+        const size_t matchStartLimit = size - LZ_MATCH_LIMIT, matchEndLimit = size - LZ_LAST_LITERALS;
+
+        while (ip < matchStartLimit) {
+            const uint32_t sequence = read32(in + ip);
+            const uint32_t h = hash32(sequence);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+
+            if (ref >= ip || ip - ref > LZ_MAX_DISTANCE || read32(in + ref) != sequence) {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+                continue;
+            }
+
+            // extend the match backwards over the pending literals, then forwards
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t matchLen = LZ_MIN_MATCH;
+            while (ip + matchLen < matchEndLimit && in[ip + matchLen] == in[ref + matchLen]) {
+                matchLen++;
+            }
+
+            op += writeSequence(out + op, in + anchor, ip - anchor, ip - ref, matchLen);
+            ip += matchLen;
+            anchor = ip;
+            if (ip < matchStartLimit) {
+                // the position right before the match's end is likely to start another one
+                table[hash32(read32(in + ip - 2))] = (uint32_t)(ip - 2);
+            }
+        }
+    }
+    op += writeSequence(out + op, in + anchor, size - anchor, 0, 0);
+    return op;
+}
+
+size_t LZdecompress(const char* src, size_t compressedSize, char* dest, size_t uncompressedSize) {
+    /**
+     * @brief Decompresses the output of `LZcompress` into `dest`, stopping after `uncompressedSize` bytes.
+     * @details Decompression can be stopped early by passing a smaller `uncompressedSize` than the original \n
+     * size of the data. Malformed input stops decompression rather than reading or writing out of bounds.
+     *
+     * @return The number of bytes written to `dest`
+     */
+    const unsigned char* in = (const unsigned char*)src;
+    unsigned char* out = (unsigned char*)dest;
+    size_t ip = 0, op = 0;
+
+    while (ip < compressedSize && op < uncompressedSize) {
+        const unsigned token = in[ip++];
+
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15) {
+            unsigned char b;
+            do {
+                b = (ip < compressedSize) ? in[ip++] : 0;
+                numLiterals += b;
+            } while (b == 255);
+        }
+        if (numLiterals > compressedSize - ip) {
+            numLiterals = compressedSize - ip;
+        }
+        if (numLiterals > uncompressedSize - op) {
+            numLiterals = uncompressedSize - op;
+        }
+        memcpy(out + op, in + ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+
+        if (compressedSize - ip < 2 || op >= uncompressedSize) {
+            break; // last sequence
+        }
+        const size_t distance = in[ip] | ((size_t)in[ip + 1] << 8);
+        ip += 2;
+        size_t matchLen = token & 15;
+        if (matchLen == 15) {
+            unsigned char b;
+            do {
+                b = (ip < compressedSize) ? in[ip++] : 0;
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += LZ_MIN_MATCH;
+        if (!distance || distance > op) {
+            break; // malformed input
+        }
+        if (matchLen > uncompressedSize - op) {
+            matchLen = uncompressedSize - op;
+        }
+
+        const unsigned char* match = out + op - distance;
+        if (distance >= matchLen) {
+            memcpy(out + op, match, matchLen);
+        }
+        else {
+            // the match overlaps the bytes it produces: copy whole periods of `distance` bytes at a time, from a
+            // source that doubles after every copy without ever overlapping the destination
+            for (size_t copied = 0; copied < matchLen;) {
+                const size_t n = (copied + distance < matchLen - copied) ? copied + distance : matchLen - copied;
+                memcpy(out + op + copied, match, n);
+                copied += n;
+            }
+        }
+        op += matchLen;
+    }
+    return op;
+}
@@ -0,0 +1,232 @@
+/*! \file */
+/**
+ * Byte-sized mutexes and condition variables, whose waiting threads are parked in a global hash table.
+ *
+ * A lock is a single byte with two bits: `LOCKED`, and `PARKED`, set when some thread might be sleeping on it.
+ * Acquiring a free lock and releasing a lock nobody is waiting for take a single compare-and-swap. Threads
+ * that can't get the lock after spinning for a while set `PARKED` and sleep in the queue of the bucket of
+ * the parking table the lock's address hashes to; releasing a lock with `PARKED` set wakes one of them up,
+ * and clears the bit if it was the last one. A condition variable is a byte that tells whether any thread
+ * is waiting on it, so that broadcasting to one nobody waits on costs a single load.
+ *
+ * Every bucket has its own mutex, guarding its queue and the decisions taken on the words hashing to it:
+ * a thread checks that it still has to sleep and enqueues itself while holding it, and the state of a word
+ * changes in a way that affects sleeping threads only while it's held, so wake-ups can't be lost. Each
+ * parked thread sleeps on a condition variable of its own, on the stack, paired with its bucket's mutex.
+ */
+
+#include "../include/parkingLot.h"
+#include "../utils/scerrhand.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define LOCKED 1
+#define PARKED 2
+#define HAS_WAITERS 1
+#define PARKING_BUCKETS 256 /**< Must be a power of two */
+#define SPIN_LIMIT 40 /**< Number of times a thread yields before parking on a lock that stays locked */
+
+struct _parkedThread {
+    const void* address;
+    pthread_cond_t cond;
+    bool unparked;
+    struct _parkedThread* next;
+};
+
+struct _bucket {
+    pthread_mutex_t mutex;
+    struct _parkedThread* head; /**< Threads parked on the words hashing to this bucket, in the order they arrived */
+    struct _parkedThread* tail;
+};
+
+static struct _bucket buckets[PARKING_BUCKETS];
+static pthread_once_t bucketsOnce = PTHREAD_ONCE_INIT;
+
+static void _initBuckets(void) {
+    for (size_t i = 0; i < PARKING_BUCKETS; i++) {
+        DIE_ON_NZ(pthread_mutex_init(&(buckets[i].mutex), NULL));
+    }
+}
+
+static struct _bucket* _lockBucket(const void* address) {
+    DIE_ON_NZ(pthread_once(&bucketsOnce, _initBuckets));
+    const uint64_t h = (uint64_t)(uintptr_t)address * 0x9E3779B97F4A7C15ULL;
+    struct _bucket* bucket = &(buckets[h >> 56 & (PARKING_BUCKETS - 1)]);
+    DIE_ON_NZ(pthread_mutex_lock(&(bucket->mutex)));
+    return bucket;
+}
+
+static void _park(const void* address, bool (*validate)(const void*), void (*beforeSleep)(void*), void* arg) {
+    /**
+     * @brief Puts the calling thread to sleep until it's woken up by `_unpark` on the same address, \n
+     * unless `validate(address)`, called with the bucket's mutex held, returns false.
+     *
+     * @param beforeSleep If not NULL, called with `arg` once the thread is in the queue, without the bucket's mutex
+     */
+    struct _bucket* bucket = _lockBucket(address);
+    if (validate && !validate(address)) {
+        DIE_ON_NZ(pthread_mutex_unlock(&(bucket->mutex)));
+        return;
+    }
+    struct _parkedThread self = { .address = address, .unparked = false, .next = NULL };
+    DIE_ON_NZ(pthread_cond_init(&(self.cond), NULL));
+    if (bucket->tail) {
+        bucket->tail->next = &self;
+    }
+    else {
+        bucket->head = &self;
+    }
+    bucket->tail = &self;
+
+    if (beforeSleep) {
+        DIE_ON_NZ(pthread_mutex_unlock(&(bucket->mutex)));
+        beforeSleep(arg);
+        DIE_ON_NZ(pthread_mutex_lock(&(bucket->mutex)));
+    }
+    // `self` is only touched by the thread that wakes us up while it holds the bucket's mutex
+    while (!self.unparked) {
+        DIE_ON_NZ(pthread_cond_wait(&(self.cond), &(bucket->mutex)));
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(bucket->mutex)));
+    DIE_ON_NZ(pthread_cond_destroy(&(self.cond)));
+}
+
+static void _unpark(const void* address, bool all, void (*callback)(void*, bool), void* arg) {
+    /**
+     * @brief Wakes up the first thread (or all the threads, if `all` is true) parked on an address.
+     *
+     * @param callback If not NULL, called with the bucket's mutex held, along with whether any threads are still \n
+     * parked on the address, once the woken threads have been removed from the queue
+     */
+    struct _bucket* bucket = _lockBucket(address);
+    struct _parkedThread** link = &(bucket->head);
+    struct _parkedThread* prev = NULL;
+    bool woken = false, moreParked = false;
+    while (*link) {
+        struct _parkedThread* curr = *link;
+        if (curr->address != address) {
+            prev = curr;
+            link = &(curr->next);
+            continue;
+        }
+        if (woken && !all) {
+            moreParked = true;
+            break;
+        }
+        *link = curr->next;
+        if (bucket->tail == curr) {
+            bucket->tail = prev;
+        }
+        curr->unparked = true;
+        DIE_ON_NZ(pthread_cond_signal(&(curr->cond)));
+        woken = true;
+    }
+    if (callback) {
+        callback(arg, moreParked);
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(bucket->mutex)));
+}
+
+static bool _stillContended(const void* lock) {
+    // only sleep if the lock hasn't been released since the caller set `PARKED`
+    return __atomic_load_n((const WordLock_t*)lock, __ATOMIC_RELAXED) == (LOCKED | PARKED);
+}
+
+static void _handOff(void* lock, bool moreParked) {
+    // releases the lock, keeping `PARKED` set if other threads are still sleeping on it
+    __atomic_store_n((WordLock_t*)lock, moreParked ? PARKED : 0, __ATOMIC_RELEASE);
+}
+
+
+void wordLock(WordLock_t* lock) {
+    /**
+     * @brief Acquires the lock, sleeping until it's available if it's held by another thread.
+     */
+    WordLock_t state = 0;
+    if (__atomic_compare_exchange_n(lock, &state, LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    for (size_t spins = 0; ; ) {
+        state = __atomic_load_n(lock, __ATOMIC_RELAXED);
+        if (!(state & LOCKED)) {
+            // threads that have just been woken up compete with newcomers
+            if (__atomic_compare_exchange_n(lock, &state, state | LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return;
+            }
+            continue;
+        }
+        // locks are usually held for short times: wait a bit before going to sleep, unless somebody's already asleep
+        if (!(state & PARKED) && spins < SPIN_LIMIT) {
+            spins++;
+            sched_yield();
+            continue;
+        }
+        if (!(state & PARKED) && !__atomic_compare_exchange_n(lock, &state, state | PARKED, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        _park(lock, _stillContended, NULL, NULL);
+    }
+}
+
+bool wordTryLock(WordLock_t* lock) {
+    /**
+     * @brief Acquires the lock if it's available, without waiting.
+     *
+     * @return Whether the lock was acquired
+     */
+    WordLock_t state = __atomic_load_n(lock, __ATOMIC_RELAXED);
+    while (!(state & LOCKED)) {
+        if (__atomic_compare_exchange_n(lock, &state, state | LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void wordUnlock(WordLock_t* lock) {
+    /**
+     * @brief Releases a lock held by the calling thread, waking up one of the threads waiting for it, if any.
+     */
+    WordLock_t state = LOCKED;
+    if (__atomic_compare_exchange_n(lock, &state, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    _unpark(lock, false, _handOff, lock);
+}
+
+static bool _registerWaiter(const void* cond) {
+    __atomic_store_n((WordCond_t*)cond, HAS_WAITERS, __ATOMIC_RELAXED);
+    return true;
+}
+
+static void _releaseLock(void* lock) {
+    wordUnlock((WordLock_t*)lock);
+}
+
+static void _clearWaiters(void* cond, bool moreParked) {
+    (void)moreParked; // broadcasts never leave anyone parked
+    __atomic_store_n((WordCond_t*)cond, 0, __ATOMIC_RELAXED);
+}
+
+void wordCondWait(WordCond_t* cond, WordLock_t* lock) {
+    /**
+     * @brief Atomically releases `lock`, which the calling thread must hold, and sleeps until `wordCondBroadcast` \n
+     * is called on `cond`; then reacquires `lock`.
+     * @note Unlike `pthread_cond_wait`, never wakes up spuriously, but callers should still check their condition in a loop.
+     */
+    _park(cond, _registerWaiter, _releaseLock, lock);
+    wordLock(lock);
+}
+
+void wordCondBroadcast(WordCond_t* cond) {
+    /**
+     * @brief Wakes up every thread waiting on `cond`. Waiters must be woken up by a thread that changed what \n
+     * they're waiting for while holding their lock, as with `pthread_cond_broadcast`.
+     */
+    if (__atomic_load_n(cond, __ATOMIC_RELAXED)) {
+        _unpark(cond, true, _clearWaiters, cond);
+    }
+}
@@ -1,3 +1,4 @@
+#include "../include/rleCompression.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdlib.h>
@@ -6,8 +7,7 @@
 #include <errno.h>
 #include <stdbool.h>
 
-char* RLEcompress(char* data, size_t origSize, size_t* compressedSize) {
-    char* ret = calloc(2 * origSize, 1);
+size_t RLEcompressTo(char* data, size_t origSize, char* ret) {
     size_t retIdx = 0, inIdx = 0;
     size_t retSize = 0;
     while (inIdx < origSize) {
@@ -40,23 +40,243 @@ char* RLEcompress(char* data, size_t origSize, size_t* compressedSize) {
 
         inIdx += count;
     }
-    *compressedSize = retSize;
+    return retSize;
+}
+
+char* RLEcompress(char* data, size_t origSize, size_t* compressedSize) {
+    char* ret = calloc(2 * origSize, 1);
+    if (ret) {
+        *compressedSize = RLEcompressTo(data, origSize, ret);
+    }
     return ret;
 }
 
-char* RLEdecompress(char* data, size_t compressedSize, size_t uncompressedSize, size_t extraAllocation) {
-    char* ret = calloc(uncompressedSize + extraAllocation, 1);
+size_t RLEdecompressTo(char* data, size_t compressedSize, size_t uncompressedSize, char* dest) {
     size_t retIdx = 0, inIdx = 0;
-    while (inIdx < compressedSize) {
-        ret[retIdx++] = data[inIdx];
-        if (data[inIdx] == data[inIdx + 1]) { // next digit is the # of occurrences
+    while (inIdx < compressedSize && retIdx < uncompressedSize) {
+        dest[retIdx++] = data[inIdx];
+        if (inIdx + 2 < compressedSize && data[inIdx] == data[inIdx + 1]) { // next digit is the # of occurrences
             size_t occ = ((data[inIdx + 2]) - '0');
             for (size_t i = 1; i < occ && retIdx < uncompressedSize; i++) {
-                ret[retIdx++] = data[inIdx];
+                dest[retIdx++] = data[inIdx];
             }
             inIdx += 2;
         }
         inIdx += 1;
     }
+    return retIdx;
+}
+
+char* RLEdecompress(char* data, size_t compressedSize, size_t uncompressedSize, size_t extraAllocation) {
+    char* ret = calloc(uncompressedSize + extraAllocation, 1);
+    if (ret) {
+        RLEdecompressTo(data, compressedSize, uncompressedSize, ret);
+    }
     return ret;
 }
+
+/*
+ * RLE v2: a binary format. The input is split into segments, each starting with a varint (7 bits per byte,
+ * least significant group first, high bit set on all bytes but the last) holding the length of the segment
+ * shifted left by one, with the lowest bit telling its type. Literal segments (bit 0) are followed by that many
+ * bytes, copied as they are; runs (bit 1) are followed by the single byte they repeat. Only runs of at least
+ * `RLE2_MIN_RUN` bytes are encoded as such, so that encoding a run never takes more space than it saves.
+ *
+ * Run boundaries are found comparing 16 (SSE2) or 32 (AVX2, if the CPU supports it) bytes at a time.
+ */
+
+#define RLE2_MIN_RUN 4
+
+#ifdef __SSE2__
+#define RLE2_SIMD
+#include <immintrin.h>
+#endif
+
+static inline size_t writeVarint(unsigned char* dest, size_t value) {
+    size_t written = 0;
+    while (value >= 0x80) {
+        dest[written++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    dest[written++] = (unsigned char)value;
+    return written;
+}
+
+static inline bool readVarint(const unsigned char* src, size_t size, size_t* pos, size_t* value) {
+    // returns false on truncated or overlong input
+    size_t result = 0;
+    for (unsigned shift = 0; *pos < size && shift < 8 * sizeof(size_t); shift += 7) {
+        const unsigned char b = src[(*pos)++];
+        result |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t scalarRunStart(const unsigned char* src, size_t from, size_t size) {
+    // first position at or after `from` starting a run of `RLE2_MIN_RUN` bytes, or `size` if there are none
+    size_t same = 1;
+    for (size_t i = from + 1; i < size; i++) {
+        same = (src[i] == src[i - 1]) ? same + 1 : 1;
+        if (same == RLE2_MIN_RUN) {
+            return i + 1 - RLE2_MIN_RUN;
+        }
+    }
+    return size;
+}
+
+static size_t scalarRunEnd(const unsigned char* src, size_t from, size_t size) {
+    // first position after `from` holding a byte different from `src[from]`, or `size` if there are none
+    size_t i = from + 1;
+    while (i < size && src[i] == src[from]) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef RLE2_SIMD
+static size_t sse2RunStart(const unsigned char* src, size_t from, size_t size) {
+    size_t i = from;
+    for (; i + 16 + RLE2_MIN_RUN - 1 <= size; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i eq = _mm_and_si128(
+            _mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)(src + i + 1))),
+            _mm_and_si128(
+                _mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)(src + i + 2))),
+                _mm_cmpeq_epi8(a, _mm_loadu_si128((const __m128i*)(src + i + 3)))
+            )
+        );
+        const unsigned mask = (unsigned)_mm_movemask_epi8(eq);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return scalarRunStart(src, i, size);
+}
+
+static size_t sse2RunEnd(const unsigned char* src, size_t from, size_t size) {
+    const __m128i value = _mm_set1_epi8((char)src[from]);
+    size_t i = from + 1;
+    for (; i + 16 <= size; i += 16) {
+        const unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(src + i)), value));
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    while (i < size && src[i] == src[from]) {
+        i++;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2RunStart(const unsigned char* src, size_t from, size_t size) {
+    size_t i = from;
+    for (; i + 32 + RLE2_MIN_RUN - 1 <= size; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i eq = _mm256_and_si256(
+            _mm256_cmpeq_epi8(a, _mm256_loadu_si256((const __m256i*)(src + i + 1))),
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(a, _mm256_loadu_si256((const __m256i*)(src + i + 2))),
+                _mm256_cmpeq_epi8(a, _mm256_loadu_si256((const __m256i*)(src + i + 3)))
+            )
+        );
+        const unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return sse2RunStart(src, i, size);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2RunEnd(const unsigned char* src, size_t from, size_t size) {
+    const __m256i value = _mm256_set1_epi8((char)src[from]);
+    size_t i = from + 1;
+    for (; i + 32 <= size; i += 32) {
+        const unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(src + i)), value));
+        if (mask != 0xFFFFFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    while (i < size && src[i] == src[from]) {
+        i++;
+    }
+    return i;
+}
+#endif
+
+size_t RLE2compressTo(const char* data, size_t origSize, char* dest) {
+    /**
+     * @brief Compresses `origSize` bytes of `data` into `dest`, which must be at least `RLE2_MAX_COMPRESSED_SIZE(origSize)` bytes long.
+     *
+     * @return The size of the compressed data
+     */
+    const unsigned char* src = (const unsigned char*)data;
+    unsigned char* out = (unsigned char*)dest;
+    size_t (*runStart)(const unsigned char*, size_t, size_t) = scalarRunStart;
+    size_t (*runEnd)(const unsigned char*, size_t, size_t) = scalarRunEnd;
+#ifdef RLE2_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        runStart = avx2RunStart;
+        runEnd = avx2RunEnd;
+    }
+    else {
+        runStart = sse2RunStart;
+        runEnd = sse2RunEnd;
+    }
+#endif
+
+    size_t op = 0, literalsStart = 0;
+    while (literalsStart < origSize) {
+        const size_t start = runStart(src, literalsStart, origSize);
+        if (start > literalsStart) {
+            op += writeVarint(out + op, (start - literalsStart) << 1);
+            memcpy(out + op, src + literalsStart, start - literalsStart);
+            op += start - literalsStart;
+        }
+        if (start == origSize) {
+            break;
+        }
+        const size_t end = runEnd(src, start, origSize);
+        op += writeVarint(out + op, ((end - start) << 1) | 1);
+        out[op++] = src[start];
+        literalsStart = end;
+    }
+    return op;
+}
+
+size_t RLE2decompressTo(const char* data, size_t compressedSize, size_t uncompressedSize, char* dest) {
+    /**
+     * @brief Decompresses the output of `RLE2compressTo` into `dest`, stopping after `uncompressedSize` bytes.
+     * @details Malformed input stops decompression rather than reading or writing out of bounds.
+     *
+     * @return The number of bytes written to `dest`
+     */
+    const unsigned char* src = (const unsigned char*)data;
+    size_t ip = 0, op = 0, header;
+    while (op < uncompressedSize && readVarint(src, compressedSize, &ip, &header)) {
+        size_t len = header >> 1;
+        if (len > uncompressedSize - op) {
+            len = uncompressedSize - op;
+        }
+        if (header & 1) {
+            if (ip == compressedSize) {
+                break;
+            }
+            memset(dest + op, src[ip++], len);
+        }
+        else {
+            if (len > compressedSize - ip) {
+                len = compressedSize - ip;
+            }
+            memcpy(dest + op, src + ip, len);
+            ip += len;
+        }
+        op += len;
+    }
+    return op;
+}
@@ -8,11 +8,14 @@
 #include <unistd.h>
 #include <sys/un.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <signal.h>
-#include "../include/rleCompression.h"
+#include <sched.h>
+#include "../include/codec.h"
 #include "../include/cacheFns.h"
 #include "../include/boundedbuffer.h"
+#include "../include/completionQueue.h"
 #include "../include/fileparser.h"
 #include "../utils/scerrhand.h"
 #include "../include/filesystemApi.h"
@@ -25,10 +28,14 @@
 #include <errno.h>
 
 #define UNIX_PATH_MAX 108
-#define MAX_CONN 10
 #define MAX_TASKS 2048
+#define MAX_COMPLETIONS 4096
+#define MAX_EVENTS 256 // max number of events returned by a single call to `epoll_wait`
+#define BACKLOG_RETRY_MS 1 // while fd's are waiting for room in the task queue, the manager checks back this often
 
-#define PIPE_BUF_LEN 5
+// client fd's are disarmed as soon as they become ready and are handed to a worker; the manager re-arms
+// them when the worker is done with the request
+#define CLIENT_EVENTS (EPOLLIN | EPOLLET | EPOLLONESHOT)
 
 #define DFL_POOLSIZE 10
 #define DFL_MAXSTORAGECAP 10000
@@ -39,13 +46,22 @@
 #define DFL_TASKBUFSIZE 2048
 #define DFL_LOGBUFSIZE 2048
 #define DFL_REPLACEMENTALGO 0
+#define DFL_GDSFTARGET GDSF_OBJECT_HIT_RATIO
+#define DFL_ADMISSIONFILTER 0
+#define DFL_COMPRESSIONCODEC CODEC_LZ
+#define DFL_HOTCACHESIZE 0 // bytes of decompressed content of the most read files kept around; 0 disables the hot cache
+#define DFL_EVICTIONHIGHWATERMARK 100 // percentage of the storage's limits; 100 disables background eviction
 
 #define STAT_MSG \
 ANSI_COLOR_BG_GREEN "       " ANSI_COLOR_RESET " Statistics: " ANSI_COLOR_BG_GREEN "       " ANSI_COLOR_RESET "\n"\
 ANSI_COLOR_CYAN "Max number of files reached: " ANSI_COLOR_RESET "%zu\n" \
 ANSI_COLOR_CYAN "Max total storage size reached: " ANSI_COLOR_RESET "%zu bytes\n" \
 ANSI_COLOR_CYAN "Number of files that have been evicted from the cache: " ANSI_COLOR_RESET "%zu\n" \
+ANSI_COLOR_CYAN "Number of new files rejected by the admission filter: " ANSI_COLOR_RESET "%zu\n" \
+ANSI_COLOR_CYAN "Number of reads served from the hot cache: " ANSI_COLOR_RESET "%zu\n" \
 ANSI_COLOR_CYAN "Number of files in the storage at the time of exit: " ANSI_COLOR_RESET "%zu\n" \
+ANSI_COLOR_CYAN "Memory overhead per file at the time of exit: " ANSI_COLOR_RESET "%zu bytes (node %zu, pathname %zu, content metadata %zu)\n" \
+ANSI_COLOR_CYAN "Memory preallocated for indexes and file nodes: " ANSI_COLOR_RESET "%zu bytes (%zu bytes per file the storage can hold)\n" \
 ANSI_COLOR_CYAN "Max number of simultaneous clients: " ANSI_COLOR_RESET "%zu\n" \
 ANSI_COLOR_CYAN "Files in the storage at the time of exit: " ANSI_COLOR_RESET "\n"
 
@@ -61,6 +77,16 @@ ANSI_COLOR_CYAN "Files in the storage at the time of exit: " ANSI_COLOR_RESET "\
 snprintf(codeBuf, RES_CODE_LEN + 1, "%d", code);\
 DIE_ON_NEG_ONE(write(fd, codeBuf, RES_CODE_LEN));
 
+// sends the length of the read content followed by the content itself, then releases the buffer holding it
+#define SEND_READ_CONTENT(fd, buffer, content, size) \
+do {\
+    char sizeBuf[METADATA_SIZE + 1] = "";\
+    snprintf(sizeBuf, METADATA_SIZE + 1, "%010ld", size);\
+    DIE_ON_NEG_ONE(writen(fd, sizeBuf, METADATA_SIZE));\
+    DIE_ON_NEG_ONE(writen(fd, (void*)content, size));\
+    releaseSharedBuffer(buffer);\
+} while (0)
+
 #define HANDLE_REQ_ERROR(fd) \
 switch(errno) {\
 case ENOENT:\
@@ -75,9 +101,15 @@ case EPERM:\
 case E2BIG:\
     SEND_RESPONSE_CODE(fd, FILE_TOO_BIG);\
     break;\
+case ENOSPC:\
+    SEND_RESPONSE_CODE(fd, NOT_ADMITTED);\
+    break;\
 case EINVAL:\
     SEND_RESPONSE_CODE(fd, BAD_REQUEST);\
     break;\
+default:\
+    SEND_RESPONSE_CODE(fd, INTERNAL_SERVER_ERROR);\
+    break;\
 }
 
 void cleanup() {
@@ -109,18 +141,16 @@ do { \
 } while(0);
 
 
-#define NOTIFY_PENDING_CLIENTS(notifyList, notifyCode, pipeBuf, pipeOut)\
+#define NOTIFY_PENDING_CLIENTS(notifyList, notifyCode, completionType, completions)\
 while (notifyList) {\
     SEND_RESPONSE_CODE(notifyList->fd, notifyCode);\
-    snprintf(pipeBuf, PIPE_BUF_LEN, "%04d", notifyList->fd);\
-    DIE_ON_NEG_ONE(write(pipeOut, pipeBuf, PIPE_BUF_LEN));\
+    DIE_ON_NEG_ONE(pushCompletion(completions, notifyList->fd, completionType));\
     struct fdNode* tmpPtr = notifyList;\
     notifyList = notifyList->nextPtr;\
     free(tmpPtr);\
 }
 
 #define NO_MORE_CONTENT "0000000000"
-#define CLIENT_LEFT_MSG "0000"
 
 char* getRequestPayloadSegment(int fd, size_t* segSize) {
     /**
@@ -156,12 +186,48 @@ char* getRequestPayloadSegment(int fd, size_t* segSize) {
 struct workerArgs {
     BoundedBuffer* buf;
     CacheStorage_t* store;
-    int pipeOut;
+    CompletionQueue* completions;
+    size_t runningWorkers; // only accessed atomically; number of workers that haven't got their termination message yet
 };
 
 volatile sig_atomic_t softExit = 0;
 volatile sig_atomic_t hardExit = 0;
 
+void* _startEvictor(void* args) {
+    /*
+    Evicts files in the background whenever the storage fills up past its high watermarks,
+    until background eviction is stopped
+    */
+    CacheStorage_t* store = ((struct workerArgs*)args)->store;
+    CompletionQueue* completions = ((struct workerArgs*)args)->completions;
+
+    char codeBuf[RES_CODE_LEN + 1] = "";
+    struct fdNode* notifyList = NULL;
+
+    while (evictInBackground(store, &notifyList)) {
+        // notify the clients that were waiting to lock the evicted files that they don't exist anymore
+        NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, COMPLETION_REARM, completions);
+    }
+    return NULL;
+}
+
+void* _startCompactor(void* args) {
+    /*
+    Merges the small chunks left behind by appends, until background compaction is stopped
+    */
+    CacheStorage_t* store = ((struct workerArgs*)args)->store;
+    CompletionQueue* completions = ((struct workerArgs*)args)->completions;
+
+    char codeBuf[RES_CODE_LEN + 1] = "";
+    struct fdNode* notifyList = NULL;
+
+    while (compactInBackground(store, &notifyList)) {
+        // notify the clients that were waiting to lock the files evicted to make room for the merged chunks
+        NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, COMPLETION_REARM, completions);
+    }
+    return NULL;
+}
+
 void exitSigHandler(int sig) {
     if (sig == SIGHUP) {
         softExit = 1;
@@ -177,7 +243,7 @@ void* _startWorker(void* args) {
     */
     BoundedBuffer* taskBuf = ((struct workerArgs*)args)->buf;
     CacheStorage_t* store = ((struct workerArgs*)args)->store;
-    int pipeOut = ((struct workerArgs*)args)->pipeOut;
+    CompletionQueue* completions = ((struct workerArgs*)args)->completions;
 
     while (true) {
         int
@@ -191,14 +257,14 @@ void* _startWorker(void* args) {
 
         char
             requestCodeBuf[REQ_CODE_LEN + 1] = "",
-            pipeBuf[PIPE_BUF_LEN] = "",
             flagBuf[2] = "", // holds the flag for `openFile`
-            argBuf[METADATA_SIZE + 1] = ""; // holds the number of files to read for `readNFiles`
+            argBuf[METADATA_SIZE + 1] = "", // holds the number of files to read for `readNFiles`
+            offsetBuf[METADATA_SIZE + 1] = "", // holds the offset of the range for `readFileRange`
+            lenBuf[METADATA_SIZE + 1] = ""; // holds the length of the range for `readFileRange`
 
         char
             * recvLine1,
-            * recvLine2,
-            * sendLine;
+            * recvLine2;
 
         struct fdNode* notifyList = NULL;
         FileNode_t* evictedList = NULL;
@@ -206,6 +272,7 @@ void* _startWorker(void* args) {
         // get ready fd from task queue
         DIE_ON_NEG_ONE(dequeue(taskBuf, (void*)&rdy_fd, sizeof(rdy_fd)));
         if (!rdy_fd) {
+            __atomic_sub_fetch(&(((struct workerArgs*)args)->runningWorkers), 1, __ATOMIC_RELEASE);
             break; // termination message
         }
 
@@ -233,10 +300,11 @@ void* _startWorker(void* args) {
                     }
                     else {
                         SEND_RESPONSE_CODE(rdy_fd, OK);
-                        // if there were clients waiting to acquire lock on the deleted file(s) notify them
-                        // that the file(s) don't exist (anymore)
-                        NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, pipeBuf, pipeOut);
                     }
+                    // if there were clients waiting to acquire lock on the deleted file(s) notify them
+                    // that the file(s) don't exist (anymore); files might have been evicted to make room
+                    // for the new one even if the request eventually failed
+                    NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, COMPLETION_REARM, completions);
                 }
                 break;
             case CLOSE_FILE:
@@ -250,23 +318,31 @@ void* _startWorker(void* args) {
                 break;
             case READ_FILE:
                 ;
-                char* outBuf;
+                SharedBuffer_t* outBuf;
+                const char* readData;
                 size_t readSize;
                 // puts("read");
-                if (readFileHandler(store, recvLine1, (void**)&outBuf, &readSize, rdy_fd) == -1) {
+                if (readFileHandler(store, recvLine1, &outBuf, rdy_fd) == -1) {
                     HANDLE_REQ_ERROR(rdy_fd);
                 }
                 else {
                     SEND_RESPONSE_CODE(rdy_fd, OK);
-                    // send file content's length and file content
-                    DIE_ON_NULL((sendLine = calloc(METADATA_SIZE + readSize + 1, 1)));
-                    snprintf(sendLine, METADATA_SIZE + 1, "%010ld", readSize);
-                    memcpy(sendLine + METADATA_SIZE, outBuf, readSize);
-                    // puts(sendLine);
-                    DIE_ON_NEG_ONE(writen(rdy_fd, sendLine, METADATA_SIZE + readSize));
-
-                    free(sendLine);
-                    free(outBuf);
+                    SEND_READ_CONTENT(rdy_fd, outBuf, outBuf->data, outBuf->size);
+                }
+                break;
+            case READ_RANGE:
+                DIE_ON_NEG_ONE(readn(rdy_fd, offsetBuf, METADATA_SIZE));
+                DIE_ON_NEG_ONE(readn(rdy_fd, lenBuf, METADATA_SIZE));
+                long rangeOffset, rangeLen;
+                if (isNumber(offsetBuf, &rangeOffset) != 0 || isNumber(lenBuf, &rangeLen) != 0 || rangeOffset < 0 || rangeLen < 0) {
+                    SEND_RESPONSE_CODE(rdy_fd, BAD_REQUEST);
+                }
+                else if (readFileRangeHandler(store, recvLine1, rangeOffset, rangeLen, &outBuf, &readData, &readSize, rdy_fd) == -1) {
+                    HANDLE_REQ_ERROR(rdy_fd);
+                }
+                else {
+                    SEND_RESPONSE_CODE(rdy_fd, OK);
+                    SEND_READ_CONTENT(rdy_fd, outBuf, readData, readSize);
                 }
                 break;
             case READ_N_FILES:
@@ -308,18 +384,18 @@ void* _startWorker(void* args) {
                     SEND_RESPONSE_CODE(rdy_fd, OK);
                     // if there were clients waiting to acquire lock on the deleted file(s),
                     // notify them that the file(s) don't exist (anymore)
-                    NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, pipeBuf, pipeOut);
+                    NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, COMPLETION_REARM, completions);
                     char* evictedBuf;
                     // send evicted files to client
                     while (evictedList) {
                         FileNode_t* tmpPtr = evictedList;
                         // decompress file content
-                        char* originalContent = RLEdecompress(evictedList->content, evictedList->contentSize, evictedList->uncompressedSize, 0);
+                        char* originalContent = decompressContent(evictedList->content, 0);
                         DIE_ON_NULL(originalContent);
                         SEND_EVICTED_FILE(rdy_fd, evictedList, evictedBuf, originalContent);
                         free(originalContent);
                         evictedList = evictedList->nextPtr;
-                        deallocFile(tmpPtr);
+                        retireFile(store, tmpPtr);
                     }
                     // tell the client there are no more evicted files to read
                     char noMoreContent[] = NO_MORE_CONTENT;
@@ -336,7 +412,7 @@ void* _startWorker(void* args) {
                 }
                 else if (outcome == -2) {
                     // client has to wait in order to acquire the lock: don't send any response for now
-                    // and don't put it back in the readset of `select`
+                    // and don't re-arm its fd
                     putFdBack = false;
                 }
                 else {
@@ -351,10 +427,8 @@ void* _startWorker(void* args) {
                     SEND_RESPONSE_CODE(rdy_fd, OK);
                     if (newLock) { // another client that was waiting on this file finally acquired the lock on it
                         SEND_RESPONSE_CODE(newLock, OK);
-                        // convert int to string
-                        snprintf(pipeBuf, PIPE_BUF_LEN, "%04d", newLock);
                         // tell manager we're done handling the request of that client
-                        DIE_ON_NEG_ONE(write(pipeOut, pipeBuf, PIPE_BUF_LEN));
+                        DIE_ON_NEG_ONE(pushCompletion(completions, newLock, COMPLETION_LOCK_GRANTED));
                     }
                 }
                 // puts("unlock");
@@ -368,7 +442,7 @@ void* _startWorker(void* args) {
                     SEND_RESPONSE_CODE(rdy_fd, OK);
                     // if there were clients waiting to acquire lock on the deleted file
                     // notify them that the file doesn't exist (anymore)
-                    NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, pipeBuf, pipeOut);
+                    NOTIFY_PENDING_CLIENTS(notifyList, FILE_NOT_FOUND, COMPLETION_REARM, completions);
                 }
                 break;
             default:
@@ -379,9 +453,8 @@ void* _startWorker(void* args) {
             if (requestCode != READ_N_FILES) {
                 free(recvLine1);
             }
-            if (putFdBack) { // we're done handling this request - tell manager to put fd back in readset
-                snprintf(pipeBuf, PIPE_BUF_LEN, "%04d", rdy_fd);
-                DIE_ON_NEG_ONE(write(pipeOut, pipeBuf, PIPE_BUF_LEN));
+            if (putFdBack) { // we're done handling this request - tell manager to re-arm the fd
+                DIE_ON_NEG_ONE(pushCompletion(completions, rdy_fd, COMPLETION_REARM));
             }
         }
         else {
@@ -393,15 +466,42 @@ void* _startWorker(void* args) {
 
             // if the client had locked one or more files, and any of them had other clients blocked waiting to acquire
             // the lock, notify them that the operation has been completed successfully (they acquired the lock)
-            NOTIFY_PENDING_CLIENTS(notifyList, OK, pipeBuf, pipeOut);
+            NOTIFY_PENDING_CLIENTS(notifyList, OK, COMPLETION_LOCK_GRANTED, completions);
 
-            // when the manager reads "0", he'll know a client left
-            DIE_ON_NEG_ONE(write(pipeOut, CLIENT_LEFT_MSG, PIPE_BUF_LEN));
+            // the fd has already been closed: the manager only needs to know the client left
+            DIE_ON_NEG_ONE(pushCompletion(completions, rdy_fd, COMPLETION_CLIENT_LEFT));
         }
     }
     return NULL;
 }
 
+static void pushToBacklog(struct fdNode** head, struct fdNode** tail, int fd) {
+    // appends a ready fd that didn't fit in the task queue to the manager's backlog
+    struct fdNode* newNode;
+    DIE_ON_NULL((newNode = malloc(sizeof(*newNode))));
+    newNode->fd = fd;
+    newNode->nextPtr = NULL;
+    if (*tail) {
+        (*tail)->nextPtr = newNode;
+    }
+    else {
+        *head = newNode;
+    }
+    *tail = newNode;
+}
+
+static void flushBacklog(BoundedBuffer* taskBuffer, struct fdNode** head, struct fdNode** tail) {
+    // moves as many fd's as there is room for from the backlog to the task queue, in the order they became ready
+    while (*head && tryEnqueue(taskBuffer, &((*head)->fd), 0) == 0) {
+        struct fdNode* tmp = *head;
+        *head = tmp->nextPtr;
+        free(tmp);
+    }
+    if (!*head) {
+        *tail = NULL;
+    }
+}
+
 
 int main(int argc, char** argv) {
     /*
@@ -430,6 +530,12 @@ int main(int argc, char** argv) {
         logBufSize,
         socketBacklog,
         replacementAlgo,
+        gdsfTarget,
+        admissionFilter,
+        compressionCodec,
+        hotCacheSize,
+        evictionHighWatermark,
+        evictionLowWatermark,
         clientCount = 0, // number of online clients
         maxSimultaneousClients = 0;
 
@@ -438,12 +544,18 @@ int main(int argc, char** argv) {
         logfilename[BUFSIZ];
 
     GET_LONGVAL_OR_EXIT(configParser, "MAXSTORAGECAP", maxStorageCap, DFL_MAXSTORAGECAP, <= 0);
+    GET_LONGVAL_OR_EXIT(configParser, "EVICTIONHIGHWATERMARK", evictionHighWatermark, DFL_EVICTIONHIGHWATERMARK, <= 0 || evictionHighWatermark > 100);
+    GET_LONGVAL_OR_EXIT(configParser, "EVICTIONLOWWATERMARK", evictionLowWatermark, evictionHighWatermark * 9 / 10, < 0 || evictionLowWatermark >= evictionHighWatermark);
     GET_LONGVAL_OR_EXIT(configParser, "MAXFILECOUNT", maxFileCount, DFL_MAXFILECOUNT, <= 0);
     GET_LONGVAL_OR_EXIT(configParser, "WORKERPOOLSIZE", workerPoolSize, DFL_POOLSIZE, <= 0);
     GET_LONGVAL_OR_EXIT(configParser, "SOCKETBACKLOG", socketBacklog, DFL_SOCKETBACKLOG, <= 0);
     GET_LONGVAL_OR_EXIT(configParser, "TASKBUFSIZE", taskBufSize, DFL_TASKBUFSIZE, <= 1);
     GET_LONGVAL_OR_EXIT(configParser, "LOGBUFSIZE", logBufSize, DFL_LOGBUFSIZE, <= 1);
-    GET_LONGVAL_OR_EXIT(configParser, "REPLACEMENTALGO", replacementAlgo, DFL_REPLACEMENTALGO, < FIFO_ALGO);
+    GET_LONGVAL_OR_EXIT(configParser, "REPLACEMENTALGO", replacementAlgo, DFL_REPLACEMENTALGO, < FIFO_ALGO || replacementAlgo >= NUM_REPLACEMENT_ALGOS);
+    GET_LONGVAL_OR_EXIT(configParser, "GDSFTARGET", gdsfTarget, DFL_GDSFTARGET, < GDSF_OBJECT_HIT_RATIO || gdsfTarget > GDSF_BYTE_HIT_RATIO);
+    GET_LONGVAL_OR_EXIT(configParser, "ADMISSIONFILTER", admissionFilter, DFL_ADMISSIONFILTER, < 0 || admissionFilter > 1);
+    GET_LONGVAL_OR_EXIT(configParser, "COMPRESSIONCODEC", compressionCodec, DFL_COMPRESSIONCODEC, < CODEC_NONE || compressionCodec >= NUM_CODECS);
+    GET_LONGVAL_OR_EXIT(configParser, "HOTCACHESIZE", hotCacheSize, DFL_HOTCACHESIZE, < 0);
     GET_VAL_OR_EXIT(configParser, "SOCKETFILENAME", sockname, DFL_SOCKNAME);
     GET_VAL_OR_EXIT(configParser, "LOGFILENAME", logfilename, DFL_LOGFILENAME);
 
@@ -473,50 +585,75 @@ int main(int argc, char** argv) {
 
     pthread_t* workers; // pool of worker threads
     pthread_t logTid; // thread that writes logs to file
+    pthread_t evictorTid; // thread that evicts files in the background, if enabled
+    pthread_t compactorTid; // thread that merges the small chunks of files
 
     int fd_socket,
-        fd_communication;
-    int fd_num = 0;
+        fd_communication,
+        fd_epoll;
 
-    int w2mPipe[2]; // worker-to-manager pipe to pass back fd's ready to be `select`ed again
-    char pipebuf[PIPE_BUF_LEN] = "";
+    CompletionQueue* completions; // used by workers to pass back fd's ready to be re-armed
+    struct completion done;
+    // ready fd's that didn't fit in the task queue: the manager never waits for room in it, as workers might
+    // be waiting for it to drain their completions
+    struct fdNode
+        * backlogHead = NULL,
+        * backlogTail = NULL;
 
     struct sockaddr_un saddr; // contains the socket address
 
-    fd_set
-        rset,    // read set
-        setsave; // copy of the original set for re-initialization
+    struct epoll_event
+        event,
+        readyEvents[MAX_EVENTS];
 
+    // allow the server to hold as many client connections as the hard limit permits
+    struct rlimit fdLimit;
+    if (getrlimit(RLIMIT_NOFILE, &fdLimit) == 0 && fdLimit.rlim_cur < fdLimit.rlim_max) {
+        fdLimit.rlim_cur = fdLimit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fdLimit);
+    }
 
-    DIE_ON_NULL((store = allocStorage(maxFileCount, maxStorageCap, replacementAlgo)));
+    DIE_ON_NULL((store = allocStorage(maxFileCount, maxStorageCap, replacementAlgo, (replacementAlgo == GDSF_ALGO) ? gdsfTarget : 0, admissionFilter)));
+    if (evictionHighWatermark < 100) {
+        DIE_ON_NEG_ONE(setEvictionWatermarks(store, evictionHighWatermark, evictionLowWatermark));
+    }
+    DIE_ON_NEG_ONE(setDefaultCodec(store, compressionCodec));
+    DIE_ON_NEG_ONE(setHotCacheSize(store, hotCacheSize));
     DIE_ON_NULL((taskBuffer = allocBoundedBuffer(MAX_TASKS, sizeof(int))));
-    DIE_ON_NEG_ONE(pipe(w2mPipe)); // open worker-to-manager pipe
+    DIE_ON_NULL((completions = allocCompletionQueue(MAX_COMPLETIONS)));
 
     strncpy(saddr.sun_path, sockname, UNIX_PATH_MAX);
     saddr.sun_family = AF_UNIX;
     // puts(sockname);
     DIE_ON_NEG_ONE((fd_socket = socket(AF_UNIX, SOCK_STREAM, 0)));
     DIE_ON_NEG_ONE(bind(fd_socket, (struct sockaddr*)&saddr, sizeof saddr));
-    DIE_ON_NEG_ONE(listen(fd_socket, MAX_CONN));
+    DIE_ON_NEG_ONE(listen(fd_socket, socketBacklog));
 
     // puts("listening");
 
-    fd_num = MAX(fd_socket, fd_num);
-
-    // initialize readset
-    FD_ZERO(&setsave);
-    FD_SET(fd_socket, &setsave);
-    FD_SET(w2mPipe[0], &setsave);
+    // initialize interest list: the listening socket and the completion queue stay armed for the whole lifetime of the server
+    DIE_ON_NEG_ONE((fd_epoll = epoll_create1(0)));
+    event.events = EPOLLIN;
+    event.data.fd = fd_socket;
+    DIE_ON_NEG_ONE(epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd_socket, &event));
+    event.data.fd = getCompletionQueueFd(completions);
+    DIE_ON_NEG_ONE(epoll_ctl(fd_epoll, EPOLL_CTL_ADD, event.data.fd, &event));
 
     struct workerArgs* threadArgs = malloc(sizeof(*threadArgs));
     threadArgs->buf = taskBuffer;
     threadArgs->store = store;
-    threadArgs->pipeOut = w2mPipe[1];
+    threadArgs->completions = completions;
+    threadArgs->runningWorkers = workerPoolSize;
 
     struct logFlusherArgs logArgs = { .store = store };
     strncpy(logArgs.pathname, logfilename, MAX_LOG_PATHNAME);
     DIE_ON_NZ(pthread_create(&logTid, NULL, logFlusher, (void*)&logArgs));
 
+    if (store->backgroundEviction) {
+        DIE_ON_NZ(pthread_create(&evictorTid, NULL, &_startEvictor, (void*)threadArgs));
+    }
+    DIE_ON_NZ(pthread_create(&compactorTid, NULL, &_startCompactor, (void*)threadArgs));
+
     DIE_ON_NULL((workers = malloc(workerPoolSize * sizeof(pthread_t))));
     // create worker threads
     for (size_t i = 0; i < workerPoolSize; i++) {
@@ -525,10 +662,11 @@ int main(int argc, char** argv) {
 
 
     while (!hardExit) {
-        rset = setsave; // re-initialize the read set
-
-        // wait for a fd to be ready for read operation
-        if ((select(fd_num + 1, &rset, NULL, NULL, NULL)) == -1) {
+        int numReady;
+        // fd's in the backlog go first, as they became ready before the ones that are about to be returned
+        flushBacklog(taskBuffer, &backlogHead, &backlogTail);
+        // wait for one or more fd's to be ready for read operation
+        if ((numReady = epoll_wait(fd_epoll, readyEvents, MAX_EVENTS, backlogHead ? BACKLOG_RETRY_MS : -1)) == -1) {
             if (errno == EINTR) {
                 if (softExit && clientCount == 0) {
                     //goto cleanup;
@@ -537,55 +675,54 @@ int main(int argc, char** argv) {
                 continue;
             }
             else {
-                perror("select");
+                perror("epoll_wait");
                 return EXIT_FAILURE;
             }
         }
 
-        // loop through the file descriptors
-        for (size_t i = 0; i < fd_num + 1; i++) {
-            if (FD_ISSET(i, &rset)) { // file descriptor is ready
-                if (i == w2mPipe[0]) { // worker is done with a request
-                    // add file descriptor back into readset
-                    DIE_ON_NEG_ONE(read(i, pipebuf, PIPE_BUF_LEN));
-
-                    if (atol(pipebuf) != 0) {
-                        FD_SET(atol(pipebuf), &setsave);
-                        fd_num = MAX(atol(pipebuf), fd_num);
-                    }
-                    else {
-                        logEvent(store->logBuffer, "CLIENT_LEFT", "", 0, -1, 0);
-                        if (--clientCount == 0 && softExit) { // reding 0 from pipe means a client left
+        // only loop through the file descriptors that are actually ready
+        for (int i = 0; i < numReady; i++) {
+            int rdy_fd = readyEvents[i].data.fd;
+            if (rdy_fd == getCompletionQueueFd(completions)) { // workers are done with one or more requests
+                DIE_ON_NEG_ONE(beginDrain(completions));
+                // handle all the completions that are pending at this time
+                while (popCompletion(completions, &done)) {
+                    if (done.type == COMPLETION_CLIENT_LEFT) {
+                        logEvent(store->logBuffer, "CLIENT_LEFT", "", 0, done.fd, 0);
+                        if (--clientCount == 0 && softExit) {
                             goto cleanup; // using `goto` to break out of nested loops
                         }
                     }
-                }
-                else if (i == fd_socket) { // first request from a new client
-                    // puts("new client connected");
-                    DIE_ON_NEG_ONE((fd_communication = accept(fd_socket, NULL, 0))); // accept incoming connection
-
-                    if (softExit) { // reject connection immediately if we're soft exiting the server
-                        DIE_ON_NEG_ONE(close(fd_communication));
-                        // puts("rejected connection because we're soft exiting");
+                    else { // re-arm file descriptor
+                        event.events = CLIENT_EVENTS;
+                        event.data.fd = done.fd;
+                        DIE_ON_NEG_ONE(epoll_ctl(fd_epoll, EPOLL_CTL_MOD, done.fd, &event));
                     }
-                    else {
-                        FD_SET(fd_communication, &setsave);
-                        clientCount += 1;
-                        maxSimultaneousClients = MAX(maxSimultaneousClients, clientCount);
-                        //printf("number of clients %zu\n", GET_CLIENT_COUNT);
+                }
+            }
+            else if (rdy_fd == fd_socket) { // first request from a new client
+                // puts("new client connected");
+                DIE_ON_NEG_ONE((fd_communication = accept(fd_socket, NULL, 0))); // accept incoming connection
 
-                        fd_num = MAX(fd_communication, fd_num);
-                        logEvent(store->logBuffer, "NEW_CLIENT", "", 0, fd_communication, 0);
-                    }
+                if (softExit) { // reject connection immediately if we're soft exiting the server
+                    DIE_ON_NEG_ONE(close(fd_communication));
+                    // puts("rejected connection because we're soft exiting");
                 }
-                else { // new request from already connected client
-                    void* fd = &i;
-                    FD_CLR(i, &setsave);
-                    if (i == fd_num) {
-                        fd_num--;
-                    }
-                    // push ready file descriptor to task queue for workers
-                    DIE_ON_NEG_ONE(enqueue(taskBuffer, fd, 0));
+                else {
+                    event.events = CLIENT_EVENTS;
+                    event.data.fd = fd_communication;
+                    DIE_ON_NEG_ONE(epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd_communication, &event));
+                    clientCount += 1;
+                    maxSimultaneousClients = MAX(maxSimultaneousClients, clientCount);
+                    //printf("number of clients %zu\n", GET_CLIENT_COUNT);
+
+                    logEvent(store->logBuffer, "NEW_CLIENT", "", 0, fd_communication, 0);
+                }
+            }
+            else { // new request from already connected client
+                // the fd has been disarmed by `EPOLLONESHOT`: push it to task queue for workers
+                if (backlogHead || tryEnqueue(taskBuffer, &rdy_fd, 0) == -1) {
+                    pushToBacklog(&backlogHead, &backlogTail, rdy_fd);
                 }
             }
         }
@@ -593,10 +730,31 @@ int main(int argc, char** argv) {
 cleanup:
     // puts("cleanup");
     ;
+    // stop the evictor before the log thread, as it logs the files it evicts, and the compactor while
+    // completions are still drained below, as it pushes some for the clients of the files it evicts
+    if (store->backgroundEviction) {
+        stopBackgroundEviction(store);
+        DIE_ON_NZ(pthread_join(evictorTid, NULL));
+    }
+    stopBackgroundCompaction(store);
+    DIE_ON_NZ(pthread_join(compactorTid, NULL));
     // send termination message(s) to workers
     int term = 0;
     for (size_t i = 0; i < workerPoolSize; i++) {
-        DIE_ON_NEG_ONE(enqueue(taskBuffer, (void*)&term, 0));
+        // workers still busy with requests might be waiting for us to drain their completions
+        while (tryEnqueue(taskBuffer, (void*)&term, 0) == -1) {
+            while (popCompletion(completions, &done));
+            sched_yield();
+        }
+    }
+    while (__atomic_load_n(&(threadArgs->runningWorkers), __ATOMIC_ACQUIRE)) {
+        while (popCompletion(completions, &done));
+        sched_yield();
+    }
+    while (backlogHead) {
+        struct fdNode* tmp = backlogHead;
+        backlogHead = tmp->nextPtr;
+        free(tmp);
     }
     // send termination message to log thread
     DIE_ON_NEG_ONE(enqueue(store->logBuffer, LOGGER_EXIT_MSG, strlen(LOGGER_EXIT_MSG)));
@@ -608,22 +766,34 @@ cleanup:
     DIE_ON_NEG_ONE(pthread_join(logTid, NULL));
 
     DIE_ON_NEG_ONE(unlink(sockname));
-    DIE_ON_NEG_ONE(close(w2mPipe[0]));
-    DIE_ON_NEG_ONE(close(w2mPipe[1]));
+    DIE_ON_NEG_ONE(close(fd_epoll));
 
     // we can access the thread without locking any mutex because we're the only thread left standing
+    StorageOverhead_t overhead;
+    storageOverhead(store, &overhead);
+    // the cost of each file is averaged over the files left, what's allocated in advance over the files the storage can hold
+    const size_t numFiles = overhead.numFiles ? overhead.numFiles : 1;
     printf(
         STAT_MSG,
         store->maxReachedFileNum,
         store->maxReachedStorageSize,
         store->numVictims,
+        store->numRejected,
+        store->numHotReads,
         store->currFileNum,
+        (overhead.nodeBytes + overhead.pathnameBytes + overhead.contentBytes) / numFiles,
+        overhead.nodeBytes / numFiles,
+        overhead.pathnameBytes / numFiles,
+        overhead.contentBytes / numFiles,
+        overhead.preallocatedBytes,
+        overhead.preallocatedBytes / store->maxFileNum,
         maxSimultaneousClients
     );
     printStore(store);
 
     // release resources on the heap
     destroyBoundedBuffer(taskBuffer);
+    destroyCompletionQueue(completions);
     destroyStorage(store);
     free(threadArgs);
     free(workers);
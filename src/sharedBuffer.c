@@ -0,0 +1,46 @@
+/*! \file */
+/**
+ * Reference-counted, immutable buffers that can be handed out to several threads at once.
+ *
+ * Whoever holds a reference can read the buffer's data without any locking, as nobody writes to it once it has
+ * been shared; the last thread to release its reference frees it.
+ */
+
+#include "../include/sharedBuffer.h"
+#include <errno.h>
+
+SharedBuffer_t* allocSharedBuffer(size_t size) {
+    /**
+     * @brief Allocates a buffer of `size` bytes, holding a single reference owned by the caller. \n
+     * Its data is uninitialized.
+     *
+     * @return The buffer, or NULL on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `ENOMEM` memory for the buffer couldn't be allocated
+     */
+    SharedBuffer_t* buf = malloc(sizeof(*buf) + (size ? size : 1));
+    if (!buf) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    buf->refs = 1;
+    buf->size = size;
+    return buf;
+}
+
+void acquireSharedBuffer(SharedBuffer_t* buf) {
+    /**
+     * @brief Takes a new reference to the buffer. The caller must already hold one.
+     */
+    __atomic_add_fetch(&(buf->refs), 1, __ATOMIC_RELAXED);
+}
+
+void releaseSharedBuffer(SharedBuffer_t* buf) {
+    /**
+     * @brief Drops a reference to the buffer, freeing it if it was the last one. Does nothing if `buf` is NULL.
+     */
+    if (buf && __atomic_sub_fetch(&(buf->refs), 1, __ATOMIC_ACQ_REL) == 0) {
+        free(buf);
+    }
+}
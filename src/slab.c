@@ -0,0 +1,197 @@
+/*! \file */
+/**
+ * Slab allocator for fixed-size objects.
+ *
+ * Objects are carved out of `SLAB_SIZE` blocks that are aligned to their size, so that the slab an object
+ * belongs to is found by masking its address, and objects carry no header of their own. Every slab keeps a
+ * list of its free objects; the allocator keeps a list of the slabs that have some, and hands out objects
+ * from the first one. A slab that becomes completely free is given back to the system, unless it's the only
+ * one with free objects left, so that a file being created and removed over and over doesn't allocate a
+ * new slab every time.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include "../include/slab.h"
+#include "../utils/scerrhand.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define SLAB_ALIGN 16 /**< Alignment of the objects, enough for any of their fields */
+
+struct _freeObj {
+    struct _freeObj* next;
+};
+
+struct _slab {
+    SlabAllocator* allocator;
+    struct _freeObj* freeList;
+    size_t numFree;
+    size_t numUntouched; /**< Objects at the end of the slab that have never been handed out (not in `freeList`) */
+    struct _slab* prev; /**< Neighbours in the allocator's list of slabs with free objects */
+    struct _slab* next;
+};
+
+struct _slabAllocator {
+    pthread_mutex_t mutex;
+    size_t objSize;
+    size_t objsPerSlab;
+    size_t firstObj; /**< Offset of the first object in a slab, after the header */
+    struct _slab* partial; /**< Slabs with at least one free object */
+    size_t numSlabs;
+};
+
+#define SLAB_OF(obj) ((struct _slab*)((uintptr_t)(obj) & ~(uintptr_t)(SLAB_SIZE - 1)))
+
+static void _unlinkSlab(SlabAllocator* allocator, struct _slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    }
+    else {
+        allocator->partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = slab->next = NULL;
+}
+
+static void _pushSlab(SlabAllocator* allocator, struct _slab* slab) {
+    slab->prev = NULL;
+    slab->next = allocator->partial;
+    if (allocator->partial) {
+        allocator->partial->prev = slab;
+    }
+    allocator->partial = slab;
+}
+
+
+SlabAllocator* allocSlabAllocator(size_t objSize) {
+    /**
+     * @brief Allocates an allocator for objects of `objSize` bytes, which must be small enough for a few of them to fit in a slab.
+     *
+     * @return The allocator, or NULL on error (sets `errno`)
+     *
+     * `errno` values: \n
+     * `EINVAL` objects are too large \n
+     * `ENOMEM` memory for the allocator couldn't be allocated
+     */
+    const size_t firstObj = (sizeof(struct _slab) + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+    objSize = (objSize + SLAB_ALIGN - 1) / SLAB_ALIGN * SLAB_ALIGN;
+    if (!objSize) {
+        objSize = SLAB_ALIGN;
+    }
+    if (objSize > (SLAB_SIZE - firstObj) / 4) {
+        errno = EINVAL;
+        return NULL;
+    }
+    SlabAllocator* allocator = calloc(1, sizeof(*allocator));
+    if (!allocator) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    DIE_ON_NZ(pthread_mutex_init(&(allocator->mutex), NULL));
+    allocator->objSize = objSize;
+    allocator->firstObj = firstObj;
+    allocator->objsPerSlab = (SLAB_SIZE - firstObj) / objSize;
+    return allocator;
+}
+
+int destroySlabAllocator(SlabAllocator* allocator) {
+    /**
+     * @brief Frees the allocator and its slabs.
+     *
+     * @note Assumes every object has been freed, so that all the remaining slabs are in the list of those with free objects.
+     *
+     * @return 0 on success, -1 on error (sets `errno`)
+     */
+    if (!allocator) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (allocator->partial) {
+        struct _slab* slab = allocator->partial;
+        allocator->partial = slab->next;
+        free(slab);
+    }
+    DIE_ON_NZ(pthread_mutex_destroy(&(allocator->mutex)));
+    free(allocator);
+    return 0;
+}
+
+void* slabAlloc(SlabAllocator* allocator) {
+    /**
+     * @brief Returns a zeroed object, or NULL if memory couldn't be allocated (sets `errno` to `ENOMEM`).
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(allocator->mutex)));
+    struct _slab* slab = allocator->partial;
+    if (!slab) {
+        void* mem;
+        if (posix_memalign(&mem, SLAB_SIZE, SLAB_SIZE)) {
+            DIE_ON_NZ(pthread_mutex_unlock(&(allocator->mutex)));
+            errno = ENOMEM;
+            return NULL;
+        }
+        slab = mem;
+        slab->allocator = allocator;
+        slab->freeList = NULL;
+        slab->numFree = slab->numUntouched = allocator->objsPerSlab;
+        _pushSlab(allocator, slab);
+        allocator->numSlabs++;
+    }
+
+    void* obj;
+    if (slab->freeList) {
+        obj = slab->freeList;
+        slab->freeList = slab->freeList->next;
+    }
+    else {
+        // objects are only threaded into the free list once they've been used, so new slabs aren't touched all at once
+        obj = (char*)slab + allocator->firstObj + (allocator->objsPerSlab - slab->numUntouched) * allocator->objSize;
+        slab->numUntouched--;
+    }
+    if (--(slab->numFree) == 0) {
+        _unlinkSlab(allocator, slab);
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(allocator->mutex)));
+
+    memset(obj, 0, allocator->objSize);
+    return obj;
+}
+
+void slabFree(void* obj) {
+    /**
+     * @brief Gives an object back to the allocator it came from. Does nothing if `obj` is NULL.
+     */
+    if (!obj) {
+        return;
+    }
+    struct _slab* slab = SLAB_OF(obj);
+    SlabAllocator* allocator = slab->allocator;
+    DIE_ON_NZ(pthread_mutex_lock(&(allocator->mutex)));
+    struct _freeObj* freeObj = obj;
+    freeObj->next = slab->freeList;
+    slab->freeList = freeObj;
+    if (slab->numFree++ == 0) {
+        _pushSlab(allocator, slab);
+    }
+    else if (slab->numFree == allocator->objsPerSlab && (slab->prev || slab->next)) {
+        _unlinkSlab(allocator, slab);
+        allocator->numSlabs--;
+        free(slab);
+    }
+    DIE_ON_NZ(pthread_mutex_unlock(&(allocator->mutex)));
+}
+
+size_t slabFootprint(SlabAllocator* allocator) {
+    /**
+     * @brief Returns the number of bytes the allocator has taken from the system.
+     */
+    DIE_ON_NZ(pthread_mutex_lock(&(allocator->mutex)));
+    const size_t bytes = sizeof(*allocator) + allocator->numSlabs * SLAB_SIZE;
+    DIE_ON_NZ(pthread_mutex_unlock(&(allocator->mutex)));
+    return bytes;
+}
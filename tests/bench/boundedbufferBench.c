@@ -0,0 +1,88 @@
+/*! \file */
+/**
+ * Microbenchmark for the `BoundedBuffer` API.
+ *
+ * For each thread count `n` in 1, 2, 4, ..., 64, starts `n` producers and `n` consumers that move
+ * a fixed total number of `int`s (like the server's task queue does with client fd's) through a buffer
+ * of `MAX_TASKS` slots, and prints the throughput in transferred elements per second.
+ *
+ * The same source is linked against every implementation of the API (see the `bench` target in the Makefile).
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "../../include/boundedbuffer.h"
+#include "../../utils/scerrhand.h"
+
+#define BUF_CAPACITY 2048
+#define TOTAL_OPS 2000000
+#define MAX_THREADS 64
+
+struct benchArgs {
+    BoundedBuffer* buf;
+    size_t ops;
+};
+
+static void* producer(void* args) {
+    struct benchArgs* bArgs = args;
+    for (size_t i = 0; i < bArgs->ops; i++) {
+        int value = (int)i + 1;
+        DIE_ON_NEG_ONE(enqueue(bArgs->buf, &value, 0));
+    }
+    return NULL;
+}
+
+static void* consumer(void* args) {
+    struct benchArgs* bArgs = args;
+    int value;
+    for (size_t i = 0; i < bArgs->ops; i++) {
+        DIE_ON_NEG_ONE(dequeue(bArgs->buf, &value, sizeof(value)));
+    }
+    return NULL;
+}
+
+static double runBench(size_t numThreads) {
+    /**
+     * @brief Runs one round of the benchmark with `numThreads` producers and as many consumers.
+     *
+     * @return The number of elements moved through the buffer per second
+     */
+    BoundedBuffer* buf;
+    pthread_t producers[MAX_THREADS], consumers[MAX_THREADS];
+    struct benchArgs args;
+    struct timespec start, end;
+
+    DIE_ON_NULL((buf = allocBoundedBuffer(BUF_CAPACITY, sizeof(int))));
+    args.buf = buf;
+    args.ops = TOTAL_OPS / numThreads;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numThreads; i++) {
+        DIE_ON_NZ(pthread_create(&consumers[i], NULL, consumer, &args));
+        DIE_ON_NZ(pthread_create(&producers[i], NULL, producer, &args));
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        DIE_ON_NZ(pthread_join(producers[i], NULL));
+        DIE_ON_NZ(pthread_join(consumers[i], NULL));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    destroyBoundedBuffer(buf);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return (args.ops * numThreads) / elapsed;
+}
+
+int main(int argc, char** argv) {
+    printf("BoundedBuffer benchmark: %s\n", argc > 1 ? argv[1] : "");
+    printf("%-28s%s\n", "producers/consumers", "ops/sec");
+    for (size_t n = 1; n <= MAX_THREADS; n *= 2) {
+        printf("%-28zu%.0f\n", n, runBench(n));
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*! \file */
+/**
+ * Microbenchmark for the compression codecs.
+ *
+ * Loads every file under a directory (`tests/dummyFiles` by default, or the one given on the command line) and,
+ * for each codec, compresses and decompresses all of them in chunks of `CHUNK_SIZE` bytes, like the server does.
+ * Prints the compression ratio (uncompressed / compressed bytes, so higher is better) of every file and of all of
+ * them together, and the compression and decompression throughput in GB of uncompressed data per second.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ftw.h>
+#include <errno.h>
+#include "../../include/codec.h"
+#include "../../include/chunkedContent.h"
+#include "../../utils/scerrhand.h"
+
+#define MIN_BENCH_NS 2e8 /**< Every measurement is repeated until it has taken at least this long */
+#define MAX_FILES 1024
+
+struct benchFile {
+    char* path;
+    char* data;
+    size_t size;
+};
+
+static struct benchFile files[MAX_FILES];
+static size_t numFiles;
+
+static double elapsedNs(struct timespec* start, struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static int loadFile(const char* path, const struct stat* sb, int type, struct FTW* ftwbuf) {
+    if (type != FTW_F || !sb->st_size || numFiles == MAX_FILES) {
+        return 0;
+    }
+    FILE* fp;
+    DIE_ON_NULL((fp = fopen(path, "r")));
+    DIE_ON_NULL((files[numFiles].data = malloc(sb->st_size)));
+    if (fread(files[numFiles].data, 1, sb->st_size, fp) != (size_t)sb->st_size) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+    DIE_ON_NULL((files[numFiles].path = strdup(path)));
+    files[numFiles++].size = sb->st_size;
+    return 0;
+}
+
+static size_t compressAll(const CompressionCodec_t* codec, char** compressed, size_t* sizes) {
+    // compresses every chunk of every file; `compressed` and `sizes` hold one entry per chunk
+    size_t totalSize = 0, chunk = 0;
+    for (size_t i = 0; i < numFiles; i++) {
+        for (size_t offset = 0; offset < files[i].size; offset += CHUNK_SIZE, chunk++) {
+            const size_t len = (files[i].size - offset < CHUNK_SIZE) ? files[i].size - offset : CHUNK_SIZE;
+            sizes[chunk] = codec->compress(files[i].data + offset, len, compressed[chunk]);
+            totalSize += sizes[chunk];
+        }
+    }
+    return totalSize;
+}
+
+static void decompressAll(const CompressionCodec_t* codec, char** compressed, size_t* sizes, char* dest) {
+    size_t chunk = 0;
+    for (size_t i = 0; i < numFiles; i++) {
+        for (size_t offset = 0; offset < files[i].size; offset += CHUNK_SIZE, chunk++) {
+            const size_t len = (files[i].size - offset < CHUNK_SIZE) ? files[i].size - offset : CHUNK_SIZE;
+            if (codec->decompress(compressed[chunk], sizes[chunk], dest, len) != len || memcmp(dest, files[i].data + offset, len)) {
+                fprintf(stderr, "%s: %s didn't decompress to its original content\n", codec->name, files[i].path);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+static void runBench(const CompressionCodec_t* codec, size_t numChunks, size_t totalSize) {
+    struct timespec start, end;
+    char** compressed;
+    size_t* sizes;
+    char* dest;
+    DIE_ON_NULL((compressed = malloc(numChunks * sizeof(*compressed))));
+    DIE_ON_NULL((sizes = malloc(numChunks * sizeof(*sizes))));
+    DIE_ON_NULL((dest = malloc(CHUNK_SIZE)));
+    for (size_t i = 0; i < numChunks; i++) {
+        DIE_ON_NULL((compressed[i] = malloc(codec->maxCompressedSize(CHUNK_SIZE))));
+    }
+
+    size_t compressedSize = 0, rounds = 0;
+    double ns = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        compressedSize = compressAll(codec, compressed, sizes);
+        rounds++;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    } while ((ns = elapsedNs(&start, &end)) < MIN_BENCH_NS);
+    const double compressGBs = (double)totalSize * rounds / ns;
+
+    rounds = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        decompressAll(codec, compressed, sizes, dest);
+        rounds++;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    } while ((ns = elapsedNs(&start, &end)) < MIN_BENCH_NS);
+    const double decompressGBs = (double)totalSize * rounds / ns;
+
+    printf("%-8s%10.2f%14.3f%16.3f\n", codec->name, (double)totalSize / compressedSize, compressGBs, decompressGBs);
+
+    for (size_t i = 0; i < numChunks; i++) {
+        free(compressed[i]);
+    }
+    free(compressed);
+    free(sizes);
+    free(dest);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = (argc > 1) ? argv[1] : "tests/dummyFiles";
+    DIE_ON_NEG_ONE(nftw(dir, loadFile, 16, FTW_PHYS));
+    if (!numFiles) {
+        fprintf(stderr, "No files to compress under %s\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    size_t numChunks = 0, totalSize = 0;
+    for (size_t i = 0; i < numFiles; i++) {
+        numChunks += (files[i].size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        totalSize += files[i].size;
+    }
+
+    // compression ratio of every file
+    char* scratch;
+    size_t scratchSize = 0;
+    for (size_t c = 0; c < NUM_CODECS; c++) {
+        if (codecs[c]->maxCompressedSize(CHUNK_SIZE) > scratchSize) {
+            scratchSize = codecs[c]->maxCompressedSize(CHUNK_SIZE);
+        }
+    }
+    DIE_ON_NULL((scratch = malloc(scratchSize)));
+    printf("%-50s%10s", "file (compression ratio)", "bytes");
+    for (size_t c = 0; c < NUM_CODECS; c++) {
+        printf("%10s", codecs[c]->name);
+    }
+    puts("");
+    for (size_t i = 0; i < numFiles; i++) {
+        const char* name = files[i].path + strlen(dir);
+        printf("%-50s%10zu", (strlen(name) > 48) ? name + strlen(name) - 48 : name, files[i].size);
+        for (size_t c = 0; c < NUM_CODECS; c++) {
+            size_t compressedSize = 0;
+            for (size_t offset = 0; offset < files[i].size; offset += CHUNK_SIZE) {
+                const size_t len = (files[i].size - offset < CHUNK_SIZE) ? files[i].size - offset : CHUNK_SIZE;
+                compressedSize += codecs[c]->compress(files[i].data + offset, len, scratch);
+            }
+            printf("%10.2f", (double)files[i].size / compressedSize);
+        }
+        puts("");
+    }
+    free(scratch);
+
+    printf("\nAll %zu files (%zu bytes, %zu chunks)\n", numFiles, totalSize, numChunks);
+    printf("%-8s%10s%14s%16s\n", "codec", "ratio", "compress GB/s", "decompress GB/s");
+    for (size_t c = 0; c < NUM_CODECS; c++) {
+        runBench(codecs[c], numChunks, totalSize);
+    }
+
+    for (size_t i = 0; i < numFiles; i++) {
+        free(files[i].path);
+        free(files[i].data);
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*! \file */
+/**
+ * Microbenchmark for pathname lookups.
+ *
+ * For each key count (10k, 1M and 10M by default, or the ones given on the command line), inserts that many
+ * absolute pathnames sharing long prefixes (like the ones clients store on the server) into both the old
+ * chained `icl_hash` table and `FileIndex`, then prints the average time of a lookup for a key that's there
+ * and for one that isn't, in random order. `FileIndex` is timed both hashing the key on every lookup and
+ * with the hash already computed, as the server does once per request.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "../../include/fileIndex.h"
+#include "../../utils/scerrhand.h"
+#include "icl_hash.h"
+
+#define KEY_SIZE 80
+#define MAX_LOOKUPS 2000000 /**< Lookups per measurement are capped so that large key counts don't take forever */
+
+static size_t numLookups;
+static char* keys; /**< `numKeys` keys of `KEY_SIZE` bytes each */
+static char* missingKeys; /**< `numLookups` keys that aren't in the tables */
+static uint64_t* hashes;
+static uint64_t* missingHashes;
+static size_t* order; /**< Random order in which the keys are looked up */
+
+static uint64_t rng = 88172645463325252ULL;
+
+static uint64_t xorshift(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void makeKey(char* dest, size_t i, const char* extension) {
+    // a few thousand distinct directories, each holding many files
+    snprintf(
+        dest, KEY_SIZE, "/home/user%02zu/projects/project%02zu/src/module%02zu/file%07zu.%s",
+        i % 7, (i / 7) % 23, (i / 161) % 31, i, extension
+    );
+}
+
+static double elapsedNs(struct timespec* start, struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static void runBench(size_t numKeys) {
+    struct timespec start, end;
+    volatile size_t found = 0; // keeps the compiler from optimizing the lookups away
+
+    numLookups = numKeys < MAX_LOOKUPS ? numKeys : MAX_LOOKUPS;
+    DIE_ON_NULL((keys = malloc(numKeys * KEY_SIZE)));
+    DIE_ON_NULL((hashes = malloc(numKeys * sizeof(*hashes))));
+    DIE_ON_NULL((missingKeys = malloc(numLookups * KEY_SIZE)));
+    DIE_ON_NULL((missingHashes = malloc(numLookups * sizeof(*missingHashes))));
+    DIE_ON_NULL((order = malloc(numLookups * sizeof(*order))));
+
+    for (size_t i = 0; i < numKeys; i++) {
+        makeKey(keys + i * KEY_SIZE, i, "c");
+        hashes[i] = hashPathname(keys + i * KEY_SIZE);
+    }
+    for (size_t i = 0; i < numLookups; i++) {
+        order[i] = xorshift() % numKeys;
+        makeKey(missingKeys + i * KEY_SIZE, order[i], "h");
+        missingHashes[i] = hashPathname(missingKeys + i * KEY_SIZE);
+    }
+
+    // old chained table, sized like the storage used to size it
+    icl_hash_t* chained;
+    DIE_ON_NULL((chained = icl_hash_create(numKeys / 10 + 1, NULL, NULL)));
+    for (size_t i = 0; i < numKeys; i++) {
+        DIE_ON_NULL(icl_hash_insert(chained, keys + i * KEY_SIZE, keys + i * KEY_SIZE));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numLookups; i++) {
+        found += icl_hash_find(chained, keys + order[i] * KEY_SIZE) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double chainedHit = elapsedNs(&start, &end) / numLookups;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numLookups; i++) {
+        found += icl_hash_find(chained, missingKeys + i * KEY_SIZE) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double chainedMiss = elapsedNs(&start, &end) / numLookups;
+    icl_hash_destroy(chained, NULL, NULL);
+
+    // open-addressing index, starting small to include the cost of growing in the insertions
+    FileIndex* index;
+    DIE_ON_NULL((index = allocFileIndex(0)));
+    for (size_t i = 0; i < numKeys; i++) {
+        DIE_ON_NEG_ONE(fileIndexInsert(index, keys + i * KEY_SIZE, hashes[i], keys + i * KEY_SIZE));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numLookups; i++) {
+        const char* key = keys + order[i] * KEY_SIZE;
+        found += fileIndexFind(index, key, hashPathname(key)) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double indexHit = elapsedNs(&start, &end) / numLookups;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numLookups; i++) {
+        const char* key = missingKeys + i * KEY_SIZE;
+        found += fileIndexFind(index, key, hashPathname(key)) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double indexMiss = elapsedNs(&start, &end) / numLookups;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numLookups; i++) {
+        found += fileIndexFind(index, keys + order[i] * KEY_SIZE, hashes[order[i]]) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double cachedHit = elapsedNs(&start, &end) / numLookups;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < numLookups; i++) {
+        found += fileIndexFind(index, missingKeys + i * KEY_SIZE, missingHashes[i]) != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double cachedMiss = elapsedNs(&start, &end) / numLookups;
+    destroyFileIndex(index);
+
+    if (found != 3 * numLookups) {
+        fprintf(stderr, "lookups returned wrong results\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-12zu%10.1f%10.1f%14.1f%10.1f%14.1f%10.1f\n", numKeys, chainedHit, chainedMiss, indexHit, indexMiss, cachedHit, cachedMiss);
+
+    free(keys);
+    free(hashes);
+    free(missingKeys);
+    free(missingHashes);
+    free(order);
+}
+
+int main(int argc, char** argv) {
+    size_t defaultSizes[] = { 10000, 1000000, 10000000 };
+
+    puts("Pathname lookup benchmark (ns/lookup)");
+    printf("%-12s%20s%24s%24s\n", "", "icl_hash", "FileIndex", "FileIndex (hash cached)");
+    printf("%-12s%10s%10s%14s%10s%14s%10s\n", "keys", "hit", "miss", "hit", "miss", "hit", "miss");
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            runBench(strtoul(argv[i], NULL, 10));
+        }
+    }
+    else {
+        for (size_t i = 0; i < sizeof(defaultSizes) / sizeof(*defaultSizes); i++) {
+            runBench(defaultSizes[i]);
+        }
+    }
+    return 0;
+}
@@ -6,6 +6,9 @@
  * This simple hash table implementation should be easy to drop into
  * any other peice of code, it does not depend on anything else :-)
  *
+ * It used to be the dictionary of the server's file storage; it's not part of the
+ * server anymore and it's only kept around as the baseline for `fileIndexBench.c`.
+ *
  * @author Jakub Kurzak
  */
  /* $Id: icl_hash.c 2838 2011-11-22 04:25:02Z mfaverge $ */
@@ -16,7 +19,7 @@
 #include <string.h>
 #include <assert.h>
 
-#include "../include/icl_hash.h"
+#include "icl_hash.h"
 
 #include <limits.h>
 
@@ -25,6 +28,9 @@
 #define THREE_QUARTERS  ((int) ((BITS_IN_int * 3) / 4))
 #define ONE_EIGHTH      ((int) (BITS_IN_int / 8))
 #define HIGH_BITS       ( ~((unsigned int)(~0) >> ONE_EIGHTH ))
+
+#define ICL_MAX_LOAD    1   /* average number of entries per bucket above which the table grows */
+#define ICL_REHASH_STEP 4   /* number of buckets moved to the new table by each operation while growing */
 /**
  * A simple string hash.
  *
@@ -59,10 +65,124 @@ int string_compare(void* a, void* b)
 }
 
 
+/**
+ * Move up to `nsteps` non-empty buckets of the old table to the new one,
+ * visiting at most 10 empty buckets per step so that each call does a bounded
+ * amount of work. Frees the old table once it's empty.
+ *
+ * @param ht -- the hash table
+ * @param nsteps -- maximum number of non-empty buckets to move
+ */
+
+static void
+icl_hash_rehash_step(icl_hash_t* ht, int nsteps)
+{
+    icl_entry_t* curr, * next;
+    unsigned int hash_val;
+    long empty_visits = (long)nsteps * 10;
+
+    if (!ht->old_buckets) return;
+
+    while (nsteps > 0 && ht->rehash_idx < ht->old_nbuckets) {
+        curr = ht->old_buckets[ht->rehash_idx];
+        if (curr == NULL) {
+            ht->rehash_idx++;
+            if (--empty_visits == 0) break;
+            continue;
+        }
+        for (; curr != NULL; curr = next) {
+            next = curr->next;
+            hash_val = curr->hash_val % ht->nbuckets;
+            curr->next = ht->buckets[hash_val];
+            ht->buckets[hash_val] = curr;
+        }
+        ht->old_buckets[ht->rehash_idx++] = NULL;
+        nsteps--;
+    }
+
+    if (ht->rehash_idx == ht->old_nbuckets) {
+        free(ht->old_buckets);
+        ht->old_buckets = NULL;
+        ht->old_nbuckets = 0;
+        ht->rehash_idx = 0;
+    }
+}
+
+/**
+ * Complete the resize in progress (if any), moving all the remaining
+ * entries to the new table.
+ *
+ * @param ht -- the hash table
+ */
+
+void
+icl_hash_rehash_all(icl_hash_t* ht)
+{
+    while (ht && ht->old_buckets)
+        icl_hash_rehash_step(ht, ht->old_nbuckets);
+}
+
+/**
+ * Start growing the table if its load factor is too high. The table is
+ * doubled and entries are then moved over incrementally by the following
+ * operations.
+ *
+ * @param ht -- the hash table
+ */
+
+static void
+icl_hash_maybe_grow(icl_hash_t* ht)
+{
+    icl_entry_t** new_buckets;
+
+    if (ht->nentries <= ht->nbuckets * ICL_MAX_LOAD || ht->nbuckets > INT_MAX / 2) return;
+
+    /* the previous resize hasn't completed yet (this is rare, as resizing
+       moves buckets faster than entries can be inserted) */
+    icl_hash_rehash_all(ht);
+
+    new_buckets = (icl_entry_t**)calloc(2 * ht->nbuckets, sizeof(icl_entry_t*));
+    if (!new_buckets) return; /* keep using the current table: chains just get longer */
+
+    ht->old_buckets = ht->buckets;
+    ht->old_nbuckets = ht->nbuckets;
+    ht->rehash_idx = 0;
+    ht->buckets = new_buckets;
+    ht->nbuckets = 2 * ht->nbuckets;
+}
+
+/**
+ * Find the link (either a bucket head or the `next` field of another entry)
+ * that points to the entry with the given key, looking in both tables.
+ *
+ * @param ht -- the hash table
+ * @param key -- the key of the item to search for
+ * @param hash_val -- the full hash of `key`
+ *
+ * @returns pointer to the link, or NULL if the key was not found.
+ */
+
+static icl_entry_t**
+icl_hash_find_link(icl_hash_t* ht, void* key, unsigned int hash_val)
+{
+    icl_entry_t** link;
+
+    for (link = &ht->buckets[hash_val % ht->nbuckets]; *link != NULL; link = &(*link)->next)
+        if ((*link)->hash_val == hash_val && ht->hash_key_compare((*link)->key, key))
+            return link;
+
+    if (ht->old_buckets)
+        for (link = &ht->old_buckets[hash_val % ht->old_nbuckets]; *link != NULL; link = &(*link)->next)
+            if ((*link)->hash_val == hash_val && ht->hash_key_compare((*link)->key, key))
+                return link;
+
+    return NULL;
+}
+
 /**
  * Create a new hash table.
  *
- * @param[in] nbuckets -- number of buckets to create
+ * @param[in] nbuckets -- initial number of buckets (the table grows as entries are inserted)
  * @param[in] hash_function -- pointer to the hashing function to be used
  * @param[in] hash_key_compare -- pointer to the hash key comparison function to be used
  *
@@ -73,18 +193,23 @@ icl_hash_t*
 icl_hash_create(int nbuckets, unsigned int (*hash_function)(void*), int (*hash_key_compare)(void*, void*))
 {
     icl_hash_t* ht;
-    int i;
+
+    if (nbuckets < 1) nbuckets = 1;
 
     ht = (icl_hash_t*)malloc(sizeof(icl_hash_t));
     if (!ht) return NULL;
 
     ht->nentries = 0;
-    ht->buckets = (icl_entry_t**)malloc(nbuckets * sizeof(icl_entry_t*));
-    if (!ht->buckets) return NULL;
+    ht->buckets = (icl_entry_t**)calloc(nbuckets, sizeof(icl_entry_t*));
+    if (!ht->buckets) {
+        free(ht);
+        return NULL;
+    }
 
     ht->nbuckets = nbuckets;
-    for (i = 0;i < ht->nbuckets;i++)
-        ht->buckets[i] = NULL;
+    ht->old_buckets = NULL;
+    ht->old_nbuckets = 0;
+    ht->rehash_idx = 0;
 
     ht->hash_function = hash_function ? hash_function : hash_pjw;
     ht->hash_key_compare = hash_key_compare ? hash_key_compare : string_compare;
@@ -105,18 +230,15 @@ icl_hash_create(int nbuckets, unsigned int (*hash_function)(void*), int (*hash_k
 void*
 icl_hash_find(icl_hash_t* ht, void* key)
 {
-    icl_entry_t* curr;
-    unsigned int hash_val;
+    icl_entry_t** link;
 
     if (!ht || !key) return NULL;
 
-    hash_val = (*ht->hash_function)(key) % ht->nbuckets;
+    icl_hash_rehash_step(ht, ICL_REHASH_STEP);
 
-    for (curr = ht->buckets[hash_val]; curr != NULL; curr = curr->next)
-        if (ht->hash_key_compare(curr->key, key))
-            return(curr->data);
+    link = icl_hash_find_link(ht, key, (*ht->hash_function)(key));
 
-    return NULL;
+    return link ? (*link)->data : NULL;
 }
 
 /**
@@ -137,11 +259,12 @@ icl_hash_insert(icl_hash_t* ht, void* key, void* data)
 
     if (!ht || !key) return NULL;
 
-    hash_val = (*ht->hash_function)(key) % ht->nbuckets;
+    icl_hash_rehash_step(ht, ICL_REHASH_STEP);
+
+    hash_val = (*ht->hash_function)(key);
 
-    for (curr = ht->buckets[hash_val]; curr != NULL; curr = curr->next)
-        if (ht->hash_key_compare(curr->key, key))
-            return(NULL); /* key already exists */
+    if (icl_hash_find_link(ht, key, hash_val))
+        return(NULL); /* key already exists */
 
     /* if key was not found */
     curr = (icl_entry_t*)malloc(sizeof(icl_entry_t));
@@ -149,11 +272,14 @@ icl_hash_insert(icl_hash_t* ht, void* key, void* data)
 
     curr->key = key;
     curr->data = data;
-    curr->next = ht->buckets[hash_val]; /* add at start */
+    curr->hash_val = hash_val;
+    curr->next = ht->buckets[hash_val % ht->nbuckets]; /* add at start */
 
-    ht->buckets[hash_val] = curr;
+    ht->buckets[hash_val % ht->nbuckets] = curr;
     ht->nentries++;
 
+    icl_hash_maybe_grow(ht);
+
     return curr;
 }
 
@@ -171,27 +297,26 @@ icl_hash_insert(icl_hash_t* ht, void* key, void* data)
 icl_entry_t*
 icl_hash_update_insert(icl_hash_t* ht, void* key, void* data, void** olddata)
 {
-    icl_entry_t* curr, * prev;
+    icl_entry_t* curr, ** link;
     unsigned int hash_val;
 
     if (!ht || !key) return NULL;
 
-    hash_val = (*ht->hash_function)(key) % ht->nbuckets;
-
-    /* Scan bucket[hash_val] for key */
-    for (prev = NULL, curr = ht->buckets[hash_val]; curr != NULL; prev = curr, curr = curr->next)
-        /* If key found, remove node from list, free old key, and setup olddata for the return */
-        if (ht->hash_key_compare(curr->key, key)) {
-            if (olddata != NULL) {
-                *olddata = curr->data;
-                free(curr->key);
-            }
-
-            if (prev == NULL)
-                ht->buckets[hash_val] = curr->next;
-            else
-                prev->next = curr->next;
+    icl_hash_rehash_step(ht, ICL_REHASH_STEP);
+
+    hash_val = (*ht->hash_function)(key);
+
+    /* If key found, remove node from list, free old key, and setup olddata for the return */
+    if ((link = icl_hash_find_link(ht, key, hash_val)) != NULL) {
+        curr = *link;
+        if (olddata != NULL) {
+            *olddata = curr->data;
+            free(curr->key);
         }
+        *link = curr->next;
+        ht->nentries--;
+        free(curr);
+    }
 
     /* Since key was either not found, or found-and-removed, create and prepend new node */
     curr = (icl_entry_t*)malloc(sizeof(icl_entry_t));
@@ -199,13 +324,13 @@ icl_hash_update_insert(icl_hash_t* ht, void* key, void* data, void** olddata)
 
     curr->key = key;
     curr->data = data;
-    curr->next = ht->buckets[hash_val]; /* add at start */
+    curr->hash_val = hash_val;
+    curr->next = ht->buckets[hash_val % ht->nbuckets]; /* add at start */
 
-    ht->buckets[hash_val] = curr;
+    ht->buckets[hash_val % ht->nbuckets] = curr;
     ht->nentries++;
 
-    if (olddata != NULL && *olddata != NULL)
-        *olddata = NULL;
+    icl_hash_maybe_grow(ht);
 
     return curr;
 }
@@ -222,31 +347,22 @@ icl_hash_update_insert(icl_hash_t* ht, void* key, void* data, void** olddata)
  */
 int icl_hash_delete(icl_hash_t* ht, void* key, void (*free_key)(void*), void (*free_data)(void*))
 {
-    icl_entry_t* curr, * prev;
-    unsigned int hash_val;
+    icl_entry_t* curr, ** link;
 
     if (!ht || !key) return -1;
-    hash_val = (*ht->hash_function)(key) % ht->nbuckets;
-
-    prev = NULL;
-    for (curr = ht->buckets[hash_val]; curr != NULL; ) {
-        if (ht->hash_key_compare(curr->key, key)) {
-            if (prev == NULL) {
-                ht->buckets[hash_val] = curr->next;
-            }
-            else {
-                prev->next = curr->next;
-            }
-            if (*free_key && curr->key) (*free_key)(curr->key);
-            if (*free_data && curr->data) (*free_data)(curr->data);
-            ht->nentries--; // original was `ht->nentries++;`
-            free(curr);
-            return 0;
-        }
-        prev = curr;
-        curr = curr->next;
-    }
-    return -1;
+
+    icl_hash_rehash_step(ht, ICL_REHASH_STEP);
+
+    link = icl_hash_find_link(ht, key, (*ht->hash_function)(key));
+    if (!link) return -1;
+
+    curr = *link;
+    *link = curr->next;
+    if (*free_key && curr->key) (*free_key)(curr->key);
+    if (*free_data && curr->data) (*free_data)(curr->data);
+    ht->nentries--; // original was `ht->nentries++;`
+    free(curr);
+    return 0;
 }
 
 /**
@@ -266,6 +382,8 @@ icl_hash_destroy(icl_hash_t* ht, void (*free_key)(void*), void (*free_data)(void
 
     if (!ht) return -1;
 
+    icl_hash_rehash_all(ht);
+
     for (i = 0; i < ht->nbuckets; i++) {
         bucket = ht->buckets[i];
         for (curr = bucket; curr != NULL; ) {
@@ -300,6 +418,8 @@ icl_hash_dump(FILE* stream, icl_hash_t* ht)
 
     if (!ht) return -1;
 
+    icl_hash_rehash_all(ht);
+
     for (i = 0; i < ht->nbuckets; i++) {
         bucket = ht->buckets[i];
         for (curr = bucket; curr != NULL; ) {
@@ -19,6 +19,7 @@ extern "C" {
     typedef struct icl_entry_s {
         void* key;
         void* data;
+        unsigned int hash_val; /* full hash of the key: entries are moved to a bigger table without hashing their key again */
         struct icl_entry_s* next;
     } icl_entry_t;
 
@@ -28,6 +29,11 @@ extern "C" {
         icl_entry_t** buckets;
         unsigned int (*hash_function)(void*);
         int (*hash_key_compare)(void*, void*);
+        /* while the table is growing, entries are moved a few buckets at a time from
+           `old_buckets` to `buckets`; `old_buckets` is NULL when no resize is in progress */
+        int old_nbuckets;
+        int rehash_idx; /* buckets of `old_buckets` before this index have already been moved */
+        icl_entry_t** old_buckets;
     } icl_hash_t;
 
     icl_hash_t*
@@ -46,6 +52,9 @@ extern "C" {
 
     int icl_hash_delete(icl_hash_t* ht, void* key, void (*free_key)(void*), void (*free_data)(void*));
 
+    void
+        icl_hash_rehash_all(icl_hash_t* ht);
+
     /* simple hash function */
     unsigned int
         hash_pjw(void* key);
@@ -55,6 +64,7 @@ extern "C" {
         string_compare(void* a, void* b);
 
 
+/* the table must not be in the middle of a resize: see `icl_hash_rehash_all` */
 #define icl_hash_foreach(ht, tmpint, tmpent, kp, dp)    \
     for (tmpint=0;tmpint<ht->nbuckets; tmpint++)        \
         for (tmpent=ht->buckets[tmpint];                                \
@@ -5,7 +5,7 @@ SCRIPTPATH="$( cd -- "$(dirname "$0")" >/dev/null 2>&1 ; pwd -P )"
 valgrind --leak-check=full build/server tests/config/test1config.txt &
 SERVER_PID=$!
 export SERVER_PID
-bash -c 'sleep 5 && kill -1 ${SERVER_PID}' &
+bash -c 'sleep 8 && kill -1 ${SERVER_PID}' &
 TIMER_PID=$!
 
 # write `file1` and `file2` from subdir `dummyFiles`, then read them from
@@ -16,6 +16,23 @@ build/client -p -t 200 -f serversocket.sk -W tests/dummyFiles/file1,tests/dummyF
 # the server and store them in subdir `test1dest2`
 build/client -p -t 200 -f serversocket.sk -w tests/dummyFiles/rec,0  -R 0 -d tests/test1dest2
 
+# write `randbig` (random bytes, which are stored as they are) and `big1` (which gets compressed), then read ranges
+# of them and check they match the same ranges read by `dd`: one that spans several chunks, one that ends past
+# the end of the file, one that's empty and one that starts past the end of the file
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/randbig,tests/dummyFiles/bigfiles/big1
+RANGE_MISMATCHES=0
+for RANGE in randbig,60000,10000 big1,65000,200000 randbig,819000,1000 big1,100,0 randbig,900000,10
+do
+    IFS=, read -r FILE OFFSET LEN <<< "${RANGE}"
+    rm -f tests/test1dest3${SCRIPTPATH}/dummyFiles/bigfiles/${FILE}
+    build/client -p -f serversocket.sk -g ${SCRIPTPATH}/dummyFiles/bigfiles/${FILE},${OFFSET},${LEN} -d tests/test1dest3
+    if ! dd if=tests/dummyFiles/bigfiles/${FILE} iflag=skip_bytes,count_bytes skip=${OFFSET} count=${LEN} status=none | cmp -s - tests/test1dest3${SCRIPTPATH}/dummyFiles/bigfiles/${FILE}
+    then
+        echo "Range ${RANGE} doesn't match"
+        RANGE_MISMATCHES=$((RANGE_MISMATCHES + 1))
+    fi
+done
+
 # lock a file and then delete it
 build/client -p -t 200 -f serversocket.sk -l ${SCRIPTPATH}/dummyFiles/file1 -c ${SCRIPTPATH}/dummyFiles/file1
 
@@ -27,4 +44,8 @@ build/client -p -t 0 -f serversocket.sk -l ${SCRIPTPATH}/dummyFiles/file2
 wait $TIMER_PID
 wait $SERVER_PID
 
+if [[ ${RANGE_MISMATCHES} -gt 0 ]]
+then
+    exit 1
+fi
 exit 0
\ No newline at end of file
@@ -15,8 +15,6 @@ echo ""
 # write `big2` and `randbig` which both fit in the storage
 build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big2,tests/dummyFiles/bigfiles/randbig
 
-# make sure the clock ticks
-sleep 1
 # read `big2` to update its last ref time
 build/client -p -f serversocket.sk -r ${SCRIPTPATH}/dummyFiles/bigfiles/big2
 
@@ -84,6 +82,95 @@ build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big2,tests/dummy
 # write `big1` which will cause the eviction of both `big2` and `randbig`, and store both in subdir `evicted3`
 build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big1  -D tests/evicted3
 
+wait $SERVER_PID
+wait $TIMER_PID
+sleep 2
+
+
+# --------------------------------------------------------------------------------------
+
+
+build/server tests/config/test2config3.txt &
+SERVER_PID=$!
+export SERVER_PID
+bash -c 'sleep 3 && kill -1 ${SERVER_PID}' &
+TIMER_PID=$!
+
+echo ""
+echo -e "${GREEN}BATTERY 4 - USING GDSF REPLACEMENT ALGORITHM${RESET_COLOR}"
+echo ""
+
+# write two small files and read them, so that they're both small and used more than once
+build/client -p -f serversocket.sk -W tests/dummyFiles/file1,tests/dummyFiles/rec1/file1
+build/client -p -f serversocket.sk -r ${SCRIPTPATH}/dummyFiles/file1,${SCRIPTPATH}/dummyFiles/rec1/file1
+
+# write `randbig`, which still fits in the storage
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/randbig
+
+# write `big4` which will cause the eviction of `randbig`, which is the largest and least used file,
+# and store `randbig` in subdir `evicted4`: the small files stay in the storage
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big4  -D tests/evicted4
+
+wait $SERVER_PID
+wait $TIMER_PID
+sleep 2
+
+
+# --------------------------------------------------------------------------------------
+
+
+build/server tests/config/test2config4.txt &
+SERVER_PID=$!
+export SERVER_PID
+bash -c 'sleep 3 && kill -1 ${SERVER_PID}' &
+TIMER_PID=$!
+
+echo ""
+echo -e "${GREEN}BATTERY 5 - USING ARC REPLACEMENT ALGORITHM${RESET_COLOR}"
+echo ""
+
+# write `randbig` and read it, which moves it to the list of files used more than once
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/randbig
+build/client -p -f serversocket.sk -r ${SCRIPTPATH}/dummyFiles/bigfiles/randbig
+
+# write `big4`, which still fits in the storage
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big4
+
+# write `big2` which will cause the eviction of `big4`: it's more recently used than `randbig`, but it's still
+# in the list of files used once, which are evicted first; store `big4` in subdir `evicted5`
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big2  -D tests/evicted5
+
+wait $SERVER_PID
+wait $TIMER_PID
+sleep 2
+
+
+# --------------------------------------------------------------------------------------
+
+
+build/server tests/config/test2config5.txt &
+SERVER_PID=$!
+export SERVER_PID
+bash -c 'sleep 3 && kill -1 ${SERVER_PID}' &
+TIMER_PID=$!
+
+echo ""
+echo -e "${GREEN}BATTERY 6 - USING THE ADMISSION FILTER${RESET_COLOR}"
+echo ""
+
+# write `big2` and `big4` which both fit in the storage
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/big2,tests/dummyFiles/bigfiles/big4
+
+# read `big4` a few times, so that it's requested more often than a new file
+build/client -p -f serversocket.sk -r ${SCRIPTPATH}/dummyFiles/bigfiles/big4
+build/client -p -f serversocket.sk -r ${SCRIPTPATH}/dummyFiles/bigfiles/big4
+build/client -p -f serversocket.sk -r ${SCRIPTPATH}/dummyFiles/bigfiles/big4
+
+# write `randbig`, which needs both files to be evicted: `big2` is evicted, as it's requested as often as `randbig`,
+# but `big4` isn't, so `randbig` is rejected and evicted in its place; both are stored in subdir `evicted6`, and
+# the statistics show 1 rejected file
+build/client -p -f serversocket.sk -W tests/dummyFiles/bigfiles/randbig  -D tests/evicted6
+
 wait $SERVER_PID
 wait $TIMER_PID
 